@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include <string.h>
+#include "background.h"
+
+// Flag on BackgroundSolver.middle marking a slot the reader has not taken yet, and the mask of the slot number
+#define SNAPSHOT_FRESH 4
+#define SNAPSHOT_SLOT 3
+
+// Shortest time in seconds between two snapshots published during a solve
+#define SNAPSHOT_INTERVAL 0.05
+
+// Copies the solver parameters, but not the grid, from one map to another
+// Every field is copied and then the ones describing the destination's own grid, planes, edits and hooks are put back,
+// so a setting added to Map is carried over without being listed here
+static void CopySettings(Map *dst, const Map *src)
+{
+	Map own = *dst;
+	*dst = *src;
+	dst->width = own.width;
+	dst->height = own.height;
+	dst->stride = own.stride;
+	dst->value = own.value;
+	dst->cellType = own.cellType;
+	dst->action = own.action;
+	dst->gap = own.gap;
+	dst->blocked = own.blocked;
+	dst->collide = own.collide;
+	dst->memory = own.memory;
+	dst->mapping = own.mapping;
+	dst->mappingSize = own.mappingSize;
+	dst->mappingShared = own.mappingShared;
+	dst->obstacleDensity = own.obstacleDensity;
+	dst->stopReason = own.stopReason;
+	dst->errorBound = own.errorBound;
+	dst->iterations = own.iterations;
+	dst->improvements = own.improvements;
+	dst->backups = own.backups;
+	dst->solved = own.solved;
+	dst->edits = own.edits;
+	dst->editCount = own.editCount;
+	dst->editCapacity = own.editCapacity;
+	dst->sweepCallback = own.sweepCallback;
+	dst->sweepContext = own.sweepContext;
+	dst->telemetry = own.telemetry;
+}
+
+// Copies the worker's values and actions into the back slot and makes it the latest snapshot
+static void Publish(BackgroundSolver *solver, bool done)
+{
+	Snapshot *snapshot = &solver->slots[solver->back];
+	size_t cells = MapPlaneLength(&solver->map);
+
+	memcpy(snapshot->value, solver->map.value, cells * sizeof(float));
+	memcpy(snapshot->action, solver->map.action, cells * sizeof(uint8_t));
+	snapshot->request = solver->taken;
+	snapshot->iterations = solver->map.iterations;
+	snapshot->backups = solver->map.backups;
+	snapshot->done = done;
+
+	// The slot the reader gave back, or the stale latest one, becomes the next back slot
+	solver->back = atomic_exchange(&solver->middle, solver->back | SNAPSHOT_FRESH) & SNAPSHOT_SLOT;
+	clock_gettime(CLOCK_MONOTONIC, &solver->published);
+}
+
+// Sweep callback of the worker's map, publishes a snapshot now and then and stops the solve when a request is waiting
+// The callback is only set on the worker's map, which Publish reads through the solver
+static bool SweepPublish(Map *map, void *context)
+{
+	BackgroundSolver *solver = context;
+	(void)map;
+
+	if (atomic_load(&solver->cancel))
+	{
+		solver->cancelled = true;
+		return false;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if ((now.tv_sec - solver->published.tv_sec) + (now.tv_nsec - solver->published.tv_nsec) * 1e-9 >= SNAPSHOT_INTERVAL)
+	{
+		Publish(solver, false);
+	}
+
+	return true;
+}
+
+// Moves the posted request into the worker's map, called with the lock held
+static void TakeRequest(BackgroundSolver *solver)
+{
+	Map *map = &solver->map;
+	Map *request = &solver->request;
+	size_t cells = MapPlaneLength(map);
+
+	CopySettings(map, request);
+	memcpy(map->cellType, request->cellType, cells * sizeof(uint8_t));
+	memcpy(map->blocked, request->blocked, cells * sizeof(uint8_t));
+	memcpy(map->collide, request->collide, cells * sizeof(uint8_t));
+
+	// A full solve starts from the posted values, otherwise open cells keep the values of the last solve
+	for (size_t i = 0; i < cells; i++)
+	{
+		if (solver->full || map->cellType[i] != OPEN)
+		{
+			map->value[i] = request->value[i];
+		}
+	}
+
+	for (size_t k = 0; k < request->editCount; k++)
+	{
+		if (!MapRecordEdit(map, request->edits[k]))
+		{
+			solver->full = true;
+		}
+	}
+	if (solver->full)
+	{
+		map->solved = false;
+	}
+
+	request->editCount = 0;
+	solver->full = false;
+	solver->taken = solver->posted;
+	atomic_store(&solver->cancel, false);
+}
+
+// Waits for requests and solves them until told to stop
+static void *SolveThread(void *argument)
+{
+	BackgroundSolver *solver = argument;
+
+	pthread_mutex_lock(&solver->lock);
+	while (true)
+	{
+		while (!solver->stop && solver->taken == solver->posted)
+		{
+			pthread_cond_wait(&solver->wake, &solver->lock);
+		}
+		if (solver->stop)
+		{
+			break;
+		}
+		TakeRequest(solver);
+		pthread_mutex_unlock(&solver->lock);
+
+		solver->cancelled = false;
+		ValueIterationIncremental(&solver->map);
+
+		// Values left part way through a solve are only a starting point for a full one
+		if (solver->cancelled)
+		{
+			solver->map.solved = false;
+		}
+		Publish(solver, !solver->cancelled);
+
+		pthread_mutex_lock(&solver->lock);
+	}
+	pthread_mutex_unlock(&solver->lock);
+
+	return NULL;
+}
+
+// Allocates the copies of a width x height map and starts the worker, returns false if either fails
+bool BackgroundSolverInit(BackgroundSolver *solver, int width, int height)
+{
+	bool ok = MapAlloc(&solver->map, width, height);
+	ok = MapAlloc(&solver->request, width, height) && ok;
+
+	size_t cells = ok ? MapPlaneLength(&solver->map) : 0;
+	for (int slot = 0; slot < 3; slot++)
+	{
+		solver->slots[slot].value = ok ? malloc(cells * sizeof(float)) : NULL;
+		solver->slots[slot].action = ok ? malloc(cells * sizeof(uint8_t)) : NULL;
+		solver->slots[slot].request = 0;
+		ok = ok && solver->slots[slot].value != NULL && solver->slots[slot].action != NULL;
+	}
+
+	if (ok)
+	{
+		// Settings start at their defaults until the first request brings the poster's
+		MapDefaults(&solver->map);
+		MapDefaults(&solver->request);
+		GridClear(&solver->map);
+		GridClear(&solver->request);
+		solver->map.sweepCallback = SweepPublish;
+		solver->map.sweepContext = solver;
+		solver->full = true;
+		solver->stop = false;
+		solver->posted = 0;
+		solver->taken = 0;
+		atomic_init(&solver->cancel, false);
+		solver->cancelled = false;
+		solver->back = 0;
+		solver->front = 1;
+		atomic_init(&solver->middle, 2);
+		clock_gettime(CLOCK_MONOTONIC, &solver->published);
+		pthread_mutex_init(&solver->lock, NULL);
+		pthread_cond_init(&solver->wake, NULL);
+
+		if (pthread_create(&solver->thread, NULL, SolveThread, solver) == 0)
+		{
+			return true;
+		}
+
+		pthread_mutex_destroy(&solver->lock);
+		pthread_cond_destroy(&solver->wake);
+	}
+
+	for (int slot = 0; slot < 3; slot++)
+	{
+		free(solver->slots[slot].value);
+		free(solver->slots[slot].action);
+	}
+	MapFree(&solver->map);
+	MapFree(&solver->request);
+
+	return false;
+}
+
+// Hands the map's grid and edits to the worker and returns the id of the request, abandoning any solve in progress
+// The map counts as solved afterwards, its later edits go with the next request
+unsigned long BackgroundSolverPost(BackgroundSolver *solver, Map *map)
+{
+	Map *request = &solver->request;
+	size_t cells = MapPlaneLength(map);
+
+	pthread_mutex_lock(&solver->lock);
+
+	CopySettings(request, map);
+	memcpy(request->cellType, map->cellType, cells * sizeof(uint8_t));
+	memcpy(request->blocked, map->blocked, cells * sizeof(uint8_t));
+	memcpy(request->collide, map->collide, cells * sizeof(uint8_t));
+	memcpy(request->value, map->value, cells * sizeof(float));
+
+	// Edits of requests the worker has not taken yet are kept, they still have to be solved
+	for (size_t k = 0; k < map->editCount; k++)
+	{
+		if (!MapRecordEdit(request, map->edits[k]))
+		{
+			solver->full = true;
+		}
+	}
+	if (!map->solved)
+	{
+		solver->full = true;
+	}
+
+	unsigned long id = ++solver->posted;
+	atomic_store(&solver->cancel, true);
+
+	pthread_mutex_unlock(&solver->lock);
+	pthread_cond_signal(&solver->wake);
+
+	map->solved = true;
+	map->editCount = 0;
+
+	return id;
+}
+
+// Returns the latest snapshot without waiting, NULL before the first one. It stays valid until the next call.
+const Snapshot *BackgroundSolverLatest(BackgroundSolver *solver)
+{
+	// Take the latest slot only if it has changed, giving the one held so far back to the worker
+	if (atomic_load(&solver->middle) & SNAPSHOT_FRESH)
+	{
+		solver->front = atomic_exchange(&solver->middle, solver->front) & SNAPSHOT_SLOT;
+	}
+
+	Snapshot *snapshot = &solver->slots[solver->front];
+	return snapshot->request != 0 ? snapshot : NULL;
+}
+
+// Stops the worker and releases the copies
+void BackgroundSolverFree(BackgroundSolver *solver)
+{
+	pthread_mutex_lock(&solver->lock);
+	solver->stop = true;
+	atomic_store(&solver->cancel, true);
+	pthread_mutex_unlock(&solver->lock);
+	pthread_cond_signal(&solver->wake);
+	pthread_join(solver->thread, NULL);
+
+	pthread_mutex_destroy(&solver->lock);
+	pthread_cond_destroy(&solver->wake);
+	for (int slot = 0; slot < 3; slot++)
+	{
+		free(solver->slots[slot].value);
+		free(solver->slots[slot].action);
+	}
+	MapFree(&solver->map);
+	MapFree(&solver->request);
+}
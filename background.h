@@ -0,0 +1,53 @@
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "valuefunction.h"
+
+// Values and actions published by the solve thread
+typedef struct Snapshot
+{
+	float *value; // Copy of the value plane
+	uint8_t *action; // Copy of the action plane
+	unsigned long request; // Request the values were solved for, 0 before the first publish
+	int iterations; // Sweeps made so far
+	long long backups; // Backups made so far
+	bool done; // The solve of the request has finished
+} Snapshot;
+
+// Solves on a worker thread with its own copy of the map, so the thread posting requests never waits for a solve
+// Snapshots are passed back through a triple buffer: the worker fills one slot, the reader holds another, and the
+// third is the latest complete snapshot, swapped in and out with atomics so neither side takes a lock
+typedef struct BackgroundSolver
+{
+	Map map; // Worker's copy of the map, only used by the worker
+	Map request; // Grid, values and edits posted but not yet taken by the worker, guarded by lock
+	bool full; // The posted request needs a full solve, guarded by lock
+	bool stop; // Set to shut the worker down, guarded by lock
+	unsigned long posted; // Id of the last request posted, guarded by lock
+	unsigned long taken; // Id of the last request taken by the worker, guarded by lock
+	atomic_bool cancel; // Set while a request is waiting, so the worker abandons the solve it is running
+	bool cancelled; // The last solve was abandoned, only used by the worker
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake; // Signalled when a request is posted or the worker should stop
+	Snapshot slots[3];
+	int back; // Slot the worker writes, only used by the worker
+	int front; // Slot the reader holds, only used by the reader
+	atomic_int middle; // Latest complete slot, with SNAPSHOT_FRESH set until the reader takes it
+	struct timespec published; // When the worker last published a snapshot, only used by the worker
+} BackgroundSolver;
+
+// Allocates the copies of a width x height map and starts the worker, returns false if either fails
+bool BackgroundSolverInit(BackgroundSolver*, int, int);
+// Hands the map's grid and edits to the worker and returns the id of the request, abandoning any solve in progress
+// The map counts as solved afterwards, its later edits go with the next request
+unsigned long BackgroundSolverPost(BackgroundSolver*, Map*);
+// Returns the latest snapshot without waiting, NULL before the first one. It stays valid until the next call.
+const Snapshot *BackgroundSolverLatest(BackgroundSolver*);
+// Stops the worker and releases the copies
+void BackgroundSolverFree(BackgroundSolver*);
+
+#endif
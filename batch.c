@@ -0,0 +1,377 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "valuefunction.h"
+#include "threadpool.h"
+
+// Maps interleaved into the lanes of one vector, as many floats as the widest vector register of the target holds, so
+// a lane vector is always passed in a register
+#if defined(__AVX512F__)
+#define BATCH_LANES 16
+#elif defined(__AVX__)
+#define BATCH_LANES 8
+#else
+#define BATCH_LANES 4
+#endif
+
+// Maps wider than this are backed up a row at a time by the row kernel instead of being interleaved, past a few
+// vectors per row its scalar tail no longer costs more than sweeping the slowest map of a pack
+#define BATCH_LANE_MAX_WIDTH (3 * BATCH_LANES)
+
+// One value, or one mask, per lane, using the compiler's generic vector types so the same code builds for any ISA
+typedef float LaneFloat __attribute__((vector_size(BATCH_LANES * sizeof(float))));
+typedef int32_t LaneInt __attribute__((vector_size(BATCH_LANES * sizeof(int32_t))));
+
+// Work taken by one thread at a time, either a pack of up to BATCH_LANES interleaved maps or one map on its own
+typedef struct BatchItem
+{
+	Map **maps;
+	int count; // Maps in the pack, 1 for a map solved on its own
+	bool lanes; // The maps are interleaved into lanes
+} BatchItem;
+
+// Shared state of a batch solve
+typedef struct Batch
+{
+	BatchItem *items;
+	int count;
+	atomic_int next; // Next item to be taken
+} Batch;
+
+// Lane-interleaved planes of a pack, cell i of lane l is at i * BATCH_LANES + l
+typedef struct LanePack
+{
+	LaneFloat *value;
+	LaneInt *open; // -1 in the lanes whose cell is open, 0 otherwise
+	LaneInt *blocked; // Blocked mask of each lane's cell
+	LaneInt *collide; // Collide mask of each lane's cell
+} LanePack;
+
+// Picks the lanes of a where mask is -1 and the lanes of b where it is 0
+static inline LaneFloat LaneSelect(LaneInt mask, LaneFloat a, LaneFloat b)
+{
+	return (LaneFloat)(((LaneInt)a & mask) | ((LaneInt)b & ~mask));
+}
+
+// Absolute value of every lane, by clearing the sign bit
+static inline LaneFloat LaneAbs(LaneFloat a)
+{
+	return (LaneFloat)((LaneInt)a & 0x7fffffff);
+}
+
+// Returns whether two maps can share a pack, which needs the same grid size and the same transition model and
+// stopping rule, and nothing that has to watch each sweep
+static bool LaneCompatible(const Map *a, const Map *b)
+{
+	return a->width == b->width && a->height == b->height && a->probability == b->probability &&
+		a->gamma == b->gamma && a->movementPenalty == b->movementPenalty &&
+		a->collisionPenalty == b->collisionPenalty && a->theta == b->theta && a->max_iterations == b->max_iterations;
+}
+
+// Returns whether a map can be interleaved at all, rows that are a whole number of vectors are left to the row kernel
+// The lanes only stop on the change in value and only sweep full precision values, so maps asking for anything else
+// are solved on their own
+static bool LaneCandidate(const Map *map)
+{
+	return map->solver == GAUSS_SEIDEL && map->width < BATCH_LANE_MAX_WIDTH && map->width % BATCH_LANES != 0 &&
+		map->stopRule == STOP_ON_DELTA && !map->reducedPrecision && map->sweepCallback == NULL &&
+		map->telemetry == NULL;
+}
+
+// Orders maps so compatible ones are next to each other
+static int LaneCompare(const void *left, const void *right)
+{
+	const Map *a = *(Map* const*)left;
+	const Map *b = *(Map* const*)right;
+	if (LaneCandidate(a) != LaneCandidate(b))
+	{
+		return LaneCandidate(a) ? -1 : 1;
+	}
+	if (a->width != b->width)
+	{
+		return a->width < b->width ? -1 : 1;
+	}
+	if (a->height != b->height)
+	{
+		return a->height < b->height ? -1 : 1;
+	}
+	if (a->probability != b->probability)
+	{
+		return a->probability < b->probability ? -1 : 1;
+	}
+	if (a->gamma != b->gamma)
+	{
+		return a->gamma < b->gamma ? -1 : 1;
+	}
+	if (a->movementPenalty != b->movementPenalty)
+	{
+		return a->movementPenalty < b->movementPenalty ? -1 : 1;
+	}
+	if (a->collisionPenalty != b->collisionPenalty)
+	{
+		return a->collisionPenalty < b->collisionPenalty ? -1 : 1;
+	}
+	if (a->theta != b->theta)
+	{
+		return a->theta < b->theta ? -1 : 1;
+	}
+	if (a->max_iterations != b->max_iterations)
+	{
+		return a->max_iterations < b->max_iterations ? -1 : 1;
+	}
+	return 0;
+}
+
+// Solves a map on its own, on the calling thread only
+static void SolveSingle(Map *map)
+{
+	int threads = map->threads;
+	map->threads = 1;
+	ValueIteration(map);
+	map->threads = threads;
+}
+
+// Sweeps the interleaved maps of a pack in place until every lane has converged or the first map's iteration limit
+// is met. Each lane stops being updated once it has converged. The lanes back up one cell after another along each row,
+// where the row kernel of ComputeValueFunction backs up a vector of neighbouring cells at once, so a map's values agree
+// with those of a solve on its own to within theta but its sweep count can differ. Returns false if the planes could
+// not be allocated.
+static bool SolveLanes(Map **maps, int count)
+{
+	Map *first = maps[0];
+	size_t cells = MapPlaneLength(first);
+	LanePack pack;
+	pack.value = aligned_alloc(sizeof(LaneFloat), cells * sizeof(LaneFloat));
+	pack.open = aligned_alloc(sizeof(LaneInt), cells * sizeof(LaneInt));
+	pack.blocked = aligned_alloc(sizeof(LaneInt), cells * sizeof(LaneInt));
+	pack.collide = aligned_alloc(sizeof(LaneInt), cells * sizeof(LaneInt));
+	if (pack.value == NULL || pack.open == NULL || pack.blocked == NULL || pack.collide == NULL)
+	{
+		free(pack.value);
+		free(pack.open);
+		free(pack.blocked);
+		free(pack.collide);
+		return false;
+	}
+
+	// The maps are warm started as ValueIteration would before their values are packed
+	for (int lane = 0; lane < count; lane++)
+	{
+		if (maps[lane]->warmStart && !maps[lane]->solved)
+		{
+			WarmStart(maps[lane]);
+		}
+	}
+
+	// Lanes without a map hold no open cells
+	for (size_t i = 0; i < cells; i++)
+	{
+		for (int lane = 0; lane < BATCH_LANES; lane++)
+		{
+			const Map *map = maps[lane < count ? lane : 0];
+			pack.value[i][lane] = map->value[i];
+			pack.open[i][lane] = lane < count && map->cellType[i] == OPEN ? -1 : 0;
+			pack.blocked[i][lane] = map->blocked[i];
+			pack.collide[i][lane] = map->collide[i];
+		}
+	}
+
+	Transitions transitions;
+	TransitionsInit(&transitions, first);
+	LaneFloat gamma = (LaneFloat){ 0 } + transitions.gamma;
+	LaneFloat collision = (LaneFloat){ 0 } + transitions.collision;
+	LaneFloat reward[8];
+	for (int d = 0; d < 8; d++)
+	{
+		reward[d] = (LaneFloat){ 0 } + transitions.reward[d];
+	}
+
+	LaneInt active;
+	for (int lane = 0; lane < BATCH_LANES; lane++)
+	{
+		active[lane] = lane < count ? -1 : 0;
+	}
+	int iterations[BATCH_LANES] = { 0 };
+	StopReason reasons[BATCH_LANES];
+	int remaining = count;
+	int sweeps = 0;
+
+	while (remaining > 0)
+	{
+		LaneFloat delta = (LaneFloat){ 0 };
+
+		// Sweep systematically over the cells, each one reading the value just written to its left
+		for (int y = 0; y < first->height; y++)
+		{
+			for (int x = 0; x < first->width; x++)
+			{
+				size_t i = MapIndex(first, x, y);
+				LaneInt update = pack.open[i] & active;
+				LaneFloat self = pack.value[i];
+				LaneInt blocked = pack.blocked[i];
+				LaneInt collide = pack.collide[i];
+				LaneFloat target[8];
+
+				// Reward plus discounted value of the cell reached by a move in each direction, in every lane, unrolled so
+				// the targets stay in registers
+				#pragma GCC unroll 8
+				for (int d = 0; d < 8; d++)
+				{
+					LaneInt stay = -((blocked >> d) & 1);
+					LaneInt hit = -((collide >> d) & 1);
+					LaneFloat next = LaneSelect(stay, self, pack.value[i + transitions.offset[d]]);
+					target[d] = LaneSelect(hit, collision, reward[d]) + gamma * next;
+				}
+
+				// Each action combines its own direction with the two directions either side
+				LaneFloat max_v = transitions.probability[0] * target[7];
+				max_v = max_v + transitions.probability[1] * target[0];
+				max_v = max_v + transitions.probability[2] * target[1];
+				#pragma GCC unroll 8
+				for (int action = 1; action < 8; action++)
+				{
+					LaneFloat new_v = transitions.probability[0] * target[(action + 7) & 7];
+					new_v = new_v + transitions.probability[1] * target[action];
+					new_v = new_v + transitions.probability[2] * target[(action + 1) & 7];
+					max_v = LaneSelect(new_v > max_v, new_v, max_v);
+				}
+
+				LaneFloat result = LaneSelect(update, max_v, self);
+				LaneFloat change = LaneAbs(result - self);
+				delta = LaneSelect(change > delta, change, delta);
+				pack.value[i] = result;
+			}
+		}
+
+		// Lanes stop when their own change is small enough, all of them when the maximum number of iterations is met
+		sweeps++;
+		for (int lane = 0; lane < count; lane++)
+		{
+			if (active[lane] != 0 && (delta[lane] < first->theta || sweeps > first->max_iterations))
+			{
+				active[lane] = 0;
+				iterations[lane] = sweeps;
+				reasons[lane] = delta[lane] < first->theta ? STOP_CONVERGED : STOP_MAX_ITERATIONS;
+				remaining--;
+			}
+		}
+	}
+
+	for (int lane = 0; lane < count; lane++)
+	{
+		Map *map = maps[lane];
+		for (int y = 0; y < map->height; y++)
+		{
+			for (int x = 0; x < map->width; x++)
+			{
+				size_t i = MapIndex(map, x, y);
+				map->value[i] = pack.value[i][lane];
+			}
+		}
+		map->iterations = iterations[lane];
+		map->improvements = 0;
+		map->backups = (long long)iterations[lane] * CountOpenCells(map);
+		map->stopReason = reasons[lane];
+		map->errorBound = INFINITY;
+
+		// The lanes only carry values, the policy is read off them once at the end
+		ExtractPolicy(map);
+		map->solved = true;
+		map->editCount = 0;
+	}
+
+	free(pack.value);
+	free(pack.open);
+	free(pack.blocked);
+	free(pack.collide);
+
+	return true;
+}
+
+// Takes items until there are none left
+static void BatchWorker(void *context, int thread, int threads)
+{
+	Batch *batch = context;
+	(void)thread;
+	(void)threads;
+
+	int item;
+	while ((item = atomic_fetch_add(&batch->next, 1)) < batch->count)
+	{
+		// A pack whose planes cannot be allocated is solved map by map instead
+		BatchItem *work = &batch->items[item];
+		if (work->lanes && SolveLanes(work->maps, work->count))
+		{
+			continue;
+		}
+		for (int k = 0; k < work->count; k++)
+		{
+			SolveSingle(work->maps[k]);
+		}
+	}
+}
+
+// Solves every map as ValueIteration would, spreading the maps over threads, 0 uses every core
+// Small Gauss-Seidel maps of the same size and parameters are interleaved so one vector backs up a cell of up to
+// BATCH_LANES maps at once, the others are solved one per thread. Returns false if the work list could not be
+// allocated, the maps are then solved one after another on the calling thread.
+bool ValueIterationBatch(Map *maps, int count, int threads)
+{
+	Map **order = malloc(count * sizeof(Map*));
+	BatchItem *items = malloc(count * sizeof(BatchItem));
+	if (order == NULL || items == NULL)
+	{
+		free(order);
+		free(items);
+		for (int k = 0; k < count; k++)
+		{
+			ValueIteration(&maps[k]);
+		}
+		return false;
+	}
+
+	for (int k = 0; k < count; k++)
+	{
+		order[k] = &maps[k];
+	}
+	qsort(order, count, sizeof(Map*), LaneCompare);
+
+	// Runs of compatible maps are cut into packs, everything else is an item of its own
+	int itemCount = 0;
+	for (int k = 0; k < count;)
+	{
+		int run = 1;
+		if (LaneCandidate(order[k]))
+		{
+			while (k + run < count && run < BATCH_LANES && LaneCandidate(order[k + run]) &&
+				LaneCompatible(order[k], order[k + run]))
+			{
+				run++;
+			}
+		}
+		items[itemCount++] = (BatchItem){ .maps = &order[k], .count = run, .lanes = LaneCandidate(order[k]) };
+		k += run;
+	}
+
+	Batch batch = { .items = items, .count = itemCount };
+	atomic_init(&batch.next, 0);
+
+	int poolThreads = ThreadCount(threads);
+	poolThreads = poolThreads < itemCount ? poolThreads : itemCount;
+	ThreadPool pool;
+	if (poolThreads > 1 && ThreadPoolInit(&pool, poolThreads))
+	{
+		ThreadPoolRun(&pool, BatchWorker, &batch);
+		ThreadPoolFree(&pool);
+	}
+	else
+	{
+		BatchWorker(&batch, 0, 1);
+	}
+
+	free(order);
+	free(items);
+
+	return true;
+}
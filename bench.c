@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+// make bench
+// ./bench [-n sizes] [-o densities] [-p probabilities] [-g gammas] [-a solvers] [-s seeds] [-m max_iterations]
+//         [-j threads] [-G goals] [-H holes] [-c walls] [-i] [-P preset]
+// Every option takes a comma-separated list, each combination is run in a child process from a fixed seed and
+// written as one CSV row to stdout. With -i every map is warm started from the best paths to its goals and holes
+// -P sets the options of a named comparison, options after it still apply: corridor compares Gauss-Seidel with fast
+// sweeping on a corridor winding through 16 walls, sparse compares it with prioritized sweeping on a map with one goal
+#include "valuefunction.h"
+#include "kernel.h"
+#include "threadpool.h"
+#include "scenario.h"
+
+// Most values a list option can hold
+#define BENCH_MAX_VALUES 32
+
+// Values of one list option
+typedef struct BenchList
+{
+	double values[BENCH_MAX_VALUES];
+	int count;
+} BenchList;
+
+// Settings of one benchmark run
+typedef struct BenchCase
+{
+	int size; // Width and height of the grid
+	float density; // Fraction of the cells that are obstructions
+	float probability; // Probability of moving in the chosen direction
+	float gamma; // Discount factor
+	Solver solver;
+	unsigned int seed;
+	int maxIterations;
+	int threads;
+	int goals; // Goal cells placed at random
+	int holes; // Hole cells placed at random
+	int walls; // Walls winding the grid into a corridor
+	bool warmStart; // Values seeded from the best paths to the goals and holes
+} BenchCase;
+
+// Named comparison, the lists are in the form the options take
+typedef struct BenchPreset
+{
+	const char *name;
+	const char *sizes;
+	const char *densities;
+	const char *gammas;
+	const char *solvers;
+	int goals;
+	int walls;
+} BenchPreset;
+
+static const BenchPreset presets[] =
+{
+	// Gauss-Seidel needs sweeps in proportion to the corridor's length, fast sweeping a few per bend
+	{ "corridor", "256", "0", "1", "gauss-seidel,fast-sweeping", 1, 16 },
+	// With a single goal most backups of a sweep change nothing, prioritized sweeping skips them
+	{ "sparse", "128", "0.1", "0.95", "gauss-seidel,prioritized", 1, 0 }
+};
+
+// Parses a comma-separated list of numbers, returns false if it is empty, too long or not a number
+bool ParseList(const char*, BenchList*);
+// Parses a comma-separated list of solver names, returns false if one is unknown
+bool ParseSolvers(const char*, Solver*, int*);
+// Solves one case and writes its CSV row
+void BenchRun(const BenchCase*);
+
+int main(int argc, char **argv)
+{
+	BenchList sizes = { .values = { 64, 256, 1024 }, .count = 3 };
+	BenchList densities = { .values = { 0, 0.1, 0.3 }, .count = 3 };
+	BenchList probabilities = { .values = { 0.8 }, .count = 1 };
+	BenchList gammas = { .values = { 1 }, .count = 1 };
+	BenchList seeds = { .values = { 1 }, .count = 1 };
+	Solver solvers[BENCH_MAX_VALUES] = { GAUSS_SEIDEL };
+	int solverCount = 1;
+	int maxIterations = 10000;
+	int threads = 0;
+	int goals = 1;
+	int holes = 0;
+	int walls = 0;
+	bool warmStart = false;
+
+	// The kernel's instruction set was picked at build time, without it the first sweep would crash
+	if (!KernelSupported())
+	{
+		fprintf(stderr, "This CPU lacks the %s instructions %s was built for, rebuild it on this machine\n", KernelName(),
+			argv[0]);
+		return 1;
+	}
+
+	int option;
+	bool ok = true;
+	while ((option = getopt(argc, argv, "n:o:p:g:a:s:m:j:G:H:c:iP:")) != -1 && ok)
+	{
+		switch (option)
+		{
+			case 'n': ok = ParseList(optarg, &sizes); break;
+			case 'o': ok = ParseList(optarg, &densities); break;
+			case 'p': ok = ParseList(optarg, &probabilities); break;
+			case 'g': ok = ParseList(optarg, &gammas); break;
+			case 's': ok = ParseList(optarg, &seeds); break;
+			case 'a': ok = ParseSolvers(optarg, solvers, &solverCount); break;
+			case 'm': maxIterations = atoi(optarg); break;
+			case 'j': threads = atoi(optarg); break;
+			case 'G': goals = atoi(optarg); break;
+			case 'H': holes = atoi(optarg); break;
+			case 'c': walls = atoi(optarg); break;
+			case 'i': warmStart = true; break;
+			case 'P':
+				ok = false;
+				for (size_t k = 0; k < sizeof(presets) / sizeof(presets[0]); k++)
+				{
+					const BenchPreset *preset = &presets[k];
+					if (strcmp(optarg, preset->name) == 0)
+					{
+						ok = ParseList(preset->sizes, &sizes) && ParseList(preset->densities, &densities) &&
+							ParseList(preset->gammas, &gammas) && ParseSolvers(preset->solvers, solvers, &solverCount);
+						goals = preset->goals;
+						walls = preset->walls;
+					}
+				}
+				if (!ok)
+				{
+					fprintf(stderr, "Unknown preset %s\n", optarg);
+				}
+				break;
+			default: ok = false; break;
+		}
+	}
+	if (!ok)
+	{
+		fprintf(stderr, "usage: %s [-n sizes] [-o densities] [-p probabilities] [-g gammas] [-a solvers] [-s seeds] "
+			"[-m max_iterations] [-j threads] [-G goals] [-H holes] [-c walls] [-i] [-P preset]\n", argv[0]);
+		return 1;
+	}
+
+	printf("solver,kernel,width,height,density,probability,gamma,seed,threads,open_cells,sweeps,improvements,converged,"
+		"stop_reason,backups,seconds,backups_per_second,ns_per_cell,peak_rss_kb\n");
+	fflush(stdout);
+
+	// Every combination of the lists, the seeds varying fastest and the sizes slowest
+	int cases = sizes.count * densities.count * probabilities.count * gammas.count * solverCount * seeds.count;
+	for (int c = 0; c < cases; c++)
+	{
+		int k = c;
+		int s = k % seeds.count;
+		k /= seeds.count;
+		int a = k % solverCount;
+		k /= solverCount;
+		int g = k % gammas.count;
+		k /= gammas.count;
+		int p = k % probabilities.count;
+		k /= probabilities.count;
+		int o = k % densities.count;
+		int n = k / densities.count;
+
+		BenchCase benchCase =
+		{
+			.size = (int)sizes.values[n],
+			.density = (float)densities.values[o],
+			.probability = (float)probabilities.values[p],
+			.gamma = (float)gammas.values[g],
+			.solver = solvers[a],
+			.seed = (unsigned int)seeds.values[s],
+			.maxIterations = maxIterations,
+			.threads = threads,
+			.goals = goals,
+			.holes = holes,
+			.walls = walls,
+			.warmStart = warmStart
+		};
+
+		// Each case runs in its own process so the peak memory it reports is its own
+		pid_t child = fork();
+		if (child == 0)
+		{
+			BenchRun(&benchCase);
+			fflush(stdout);
+			_exit(0);
+		}
+		if (child < 0)
+		{
+			BenchRun(&benchCase);
+		}
+		else
+		{
+			waitpid(child, NULL, 0);
+		}
+		fflush(stdout);
+	}
+
+	return 0;
+}
+
+// Parses a comma-separated list of numbers, returns false if it is empty, too long or not a number
+bool ParseList(const char *text, BenchList *list)
+{
+	list->count = 0;
+	while (*text != '\0')
+	{
+		char *end;
+		double value = strtod(text, &end);
+		if (end == text || list->count == BENCH_MAX_VALUES || (*end != ',' && *end != '\0'))
+		{
+			return false;
+		}
+		list->values[list->count++] = value;
+		text = *end == ',' ? end + 1 : end;
+	}
+	return list->count > 0;
+}
+
+// Parses a comma-separated list of solver names, returns false if one is unknown
+bool ParseSolvers(const char *text, Solver *solvers, int *count)
+{
+	char names[256];
+	snprintf(names, sizeof(names), "%s", text);
+
+	*count = 0;
+	for (char *name = strtok(names, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		if (*count == BENCH_MAX_VALUES || !SolverFromName(name, &solvers[*count]))
+		{
+			fprintf(stderr, "Unknown solver %s\n", name);
+			return false;
+		}
+		(*count)++;
+	}
+	return *count > 0;
+}
+
+// Solves one case and writes its CSV row
+void BenchRun(const BenchCase *benchCase)
+{
+	Map map;
+
+	if (!MapAlloc(&map, benchCase->size, benchCase->size))
+	{
+		fprintf(stderr, "Could not allocate a %d x %d map\n", benchCase->size, benchCase->size);
+		return;
+	}
+
+	// A case always gets the same grid from its seed, without a goal no solve converges
+	Scenario scenario =
+	{
+		.seed = benchCase->seed,
+		.obstacleDensity = benchCase->density,
+		.goals = benchCase->goals,
+		.holes = benchCase->holes,
+		.walls = benchCase->walls
+	};
+	MapDefaults(&map);
+	if (!ScenarioGenerate(&map, &scenario))
+	{
+		fprintf(stderr, "Could not generate a %d x %d map\n", benchCase->size, benchCase->size);
+		MapFree(&map);
+		return;
+	}
+	map.probability = benchCase->probability;
+	map.gamma = benchCase->gamma;
+	map.solver = benchCase->solver;
+	map.max_iterations = benchCase->maxIterations;
+	map.threads = benchCase->threads;
+	map.warmStart = benchCase->warmStart;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ValueIteration(&map);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	// Converged if the solve met its own stopping rule, rather than running out of iterations, stalling or being stopped
+	StopReason reason = map.stopReason;
+	bool converged = reason == STOP_CONVERGED || reason == STOP_POLICY_OPTIMAL || reason == STOP_VALUE_ERROR ||
+		reason == STOP_INTERVAL;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	// Only the Jacobi and red-black sweeps are spread over threads, the other solvers run on the calling one
+	int threads = map.solver == JACOBI || map.solver == RED_BLACK ? ThreadCount(map.threads) : 1;
+	double backupsPerSecond = seconds > 0 ? map.backups / seconds : 0;
+	double nsPerCell = map.backups > 0 ? seconds * 1e9 / map.backups : 0;
+
+	printf("%s,%s,%d,%d,%g,%g,%g,%u,%d,%zu,%d,%d,%d,%s,%lld,%.6f,%.0f,%.3f,%ld\n", SolverName(benchCase->solver),
+		KernelName(), map.width, map.height, benchCase->density, benchCase->probability, benchCase->gamma,
+		benchCase->seed, threads, CountOpenCells(&map), map.iterations, map.improvements, converged,
+		StopReasonName(reason), map.backups, seconds, backupsPerSecond, nsPerCell, usage.ru_maxrss);
+
+	MapFree(&map);
+}
@@ -0,0 +1,234 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "telemetry.h"
+
+// Distance of a cell no terminal can be reached from
+#define UNREACHED UINT32_MAX
+
+// Fills the value plane of the open cells with a lower bound on the optimal values and upper, unless it is NULL, with
+// an upper bound. Returns false, leaving the values as they were, if the rewards or the transition model give no sound
+// bounds or the search could not be allocated. With discounting the bounds are constants, every step either ends or costs at least the worst penalty. Without
+// it they come from each cell's fewest moves to a terminal: reaching one takes at least that many moves, each costing
+// at least the mildest penalty, and moving towards the nearest terminal gets one move closer on average every
+// probability[1] - probability[0] - probability[2] moves, each costing at most the worst penalty. A cell no terminal
+// can be reached from never stops paying and has no finite bound, so it keeps its value in both planes. Every move
+// from it leads to another such cell, so its bounds are swept alike and never differ.
+bool ValueBoundsInit(Map *map, const Transitions *t, float *upper)
+{
+	float mildest = t->collision;
+	float worst = t->collision;
+	for (int d = 0; d < 8; d++)
+	{
+		mildest = fmaxf(mildest, t->reward[d]);
+		worst = fminf(worst, t->reward[d]);
+	}
+	float drift = t->probability[1] - t->probability[0] - t->probability[2];
+	if (mildest > 0 || (t->gamma >= 1 && (mildest == 0 || drift <= 0)))
+	{
+		return false;
+	}
+
+	// Best and worst terminal values
+	float best = -INFINITY;
+	float least = INFINITY;
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == GOAL || map->cellType[i] == HOLE)
+			{
+				best = fmaxf(best, map->value[i]);
+				least = fminf(least, map->value[i]);
+			}
+		}
+	}
+
+	size_t cells = MapPlaneLength(map);
+	if (upper != NULL)
+	{
+		memcpy(upper, map->value, cells * sizeof(float));
+	}
+
+	if (t->gamma < 1)
+	{
+		float high = fmaxf(best, 0);
+		float low = fminf(least, worst / (1 - t->gamma));
+		for (int y = 0; y < map->height; y++)
+		{
+			for (int x = 0; x < map->width; x++)
+			{
+				size_t i = MapIndex(map, x, y);
+				if (map->cellType[i] == OPEN)
+				{
+					if (upper != NULL)
+					{
+						upper[i] = high;
+					}
+					map->value[i] = low;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Breadth-first search back from the terminals along the moves the transition table allows
+	uint32_t *distance = malloc(cells * sizeof(uint32_t));
+	size_t *queue = malloc(cells * sizeof(size_t));
+	if (distance == NULL || queue == NULL)
+	{
+		free(distance);
+		free(queue);
+		return false;
+	}
+	size_t head = 0;
+	size_t tail = 0;
+	for (size_t i = 0; i < cells; i++)
+	{
+		distance[i] = UNREACHED;
+	}
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == GOAL || map->cellType[i] == HOLE)
+			{
+				distance[i] = 0;
+				queue[tail++] = i;
+			}
+		}
+	}
+	while (head < tail)
+	{
+		size_t k = queue[head++];
+		for (int d = 0; d < 8; d++)
+		{
+			// The cell a move in direction d would bring here
+			size_t j = k - t->offset[d];
+			if (map->cellType[j] == OPEN && distance[j] == UNREACHED && !(map->blocked[j] >> d & 1))
+			{
+				distance[j] = distance[k] + 1;
+				queue[tail++] = j;
+			}
+		}
+	}
+
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == OPEN && distance[i] != UNREACHED)
+			{
+				if (upper != NULL)
+				{
+					upper[i] = best + mildest * distance[i];
+				}
+				map->value[i] = least + worst * distance[i] / drift;
+			}
+		}
+	}
+
+	free(distance);
+	free(queue);
+	return true;
+}
+
+// Sweeps a lower and an upper bound on the optimal values, the lower one in the value plane, until they are within
+// epsilon of each other in every open cell that can reach a terminal, then takes the midpoint, which is within half
+// the final width of the optimal values. max_iterations is not used, the solve ends when the bounds meet, when a
+// sweep no longer narrows them, which is reported as STOP_STALLED, or when the sweep callback asks to stop. Falls back
+// to ComputeValueFunction if the map gives no sound bounds: positive rewards, or without discounting no penalty on
+// every move or an action model more likely to veer than to go straight.
+void BoundedValueIteration(Map *map)
+{
+	size_t cells = MapPlaneLength(map);
+	float *upper = malloc(cells * sizeof(float));
+	Transitions transitions;
+	TransitionsInit(&transitions, map);
+	if (upper == NULL || !ValueBoundsInit(map, &transitions, upper))
+	{
+		free(upper);
+		ComputeValueFunction(map);
+		return;
+	}
+
+	bool loop = true;
+	int iterations = 0;
+	long long open = CountOpenCells(map);
+	double total = INFINITY;
+	float width = INFINITY;
+
+	TelemetryStart(map, false);
+
+	while (loop == true)
+	{
+		// Both planes are swept in place
+		for (int y = 0; y < map->height; y++)
+		{
+			BackupRow(&transitions, map, map->value, map->value, false, y, 0, map->width);
+			BackupRow(&transitions, map, upper, upper, false, y, 0, map->width);
+		}
+
+		// Widest interval, and the sum of the intervals, which can only shrink while some bound still improves
+		double sum = 0;
+		width = 0;
+		for (int y = 0; y < map->height; y++)
+		{
+			for (int x = 0; x < map->width; x++)
+			{
+				size_t i = MapIndex(map, x, y);
+				if (map->cellType[i] == OPEN)
+				{
+					float gap = upper[i] - map->value[i];
+					width = fmaxf(width, gap);
+					sum += gap;
+				}
+			}
+		}
+
+		iterations += 1;
+		map->iterations = iterations;
+		map->backups = 2 * iterations * open;
+
+		// The largest change reported for the sweep is the widest interval
+		bool more = SweepDone(map, width);
+		if (width <= map->epsilon)
+		{
+			map->stopReason = STOP_INTERVAL;
+		}
+		else if (sum >= total)
+		{
+			map->stopReason = STOP_STALLED;
+		}
+		else
+		{
+			map->stopReason = more ? STOP_NONE : STOP_CALLBACK;
+		}
+		total = sum;
+		if (map->stopReason != STOP_NONE)
+		{
+			loop = false;
+		}
+	}
+
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == OPEN)
+			{
+				map->value[i] = map->value[i] + (upper[i] - map->value[i]) / 2;
+			}
+		}
+	}
+	// The midpoint is within half the width reached of the optimal values, whether or not it got below epsilon
+	map->errorBound = width / 2;
+
+	free(upper);
+}
@@ -0,0 +1,63 @@
+#include <math.h>
+#include "valuefunction.h"
+#include "kernel.h"
+
+// Makes a Jacobi sweep of the values into a scratch plane, recording the greedy policy of the values it reads, and
+// proves a bound on that policy's loss of value from the sweep's Bellman residuals. Returns STOP_POLICY_OPTIMAL or
+// STOP_VALUE_ERROR if the policy is good enough for the map's stopping rule, and then leaves the values as they were,
+// otherwise takes the swept values and returns STOP_NONE. Stores the largest change in delta and the smallest action
+// gap in gap.
+StopReason CertifyPolicy(Map *map, const Transitions *t, float *scratch, float *delta, float *gap)
+{
+	// The kernel records the greedy action of the values it reads and the gap to the second best action
+	for (int y = 0; y < map->height; y++)
+	{
+		BackupRow(t, map, map->value, scratch, true, y, 0, map->width);
+	}
+
+	// Lowest and highest Bellman residual, and the smallest action gap. Goals and holes never change, so the
+	// residuals always take in 0.
+	float low = 0;
+	float high = 0;
+	*gap = INFINITY;
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == OPEN)
+			{
+				float residual = scratch[i] - map->value[i];
+				low = fminf(low, residual);
+				high = fmaxf(high, residual);
+				*gap = fminf(*gap, map->gap[i]);
+			}
+		}
+	}
+	*delta = fmaxf(-low, high);
+
+	// With the residuals between low and high, the optimal values lie between the values plus low / (1 - gamma) and
+	// the values plus high / (1 - gamma), so every action's optimal value lies in a band of width gamma times the
+	// span of the residuals over 1 - gamma around its value under the current values. An action that beats all the
+	// others by more than that width is optimal, otherwise the greedy action loses at most the width at each step.
+	float width = t->gamma * (high - low) / (1 - t->gamma);
+	map->errorBound = *gap > width ? 0 : width / (1 - t->gamma);
+	if (*gap > width)
+	{
+		return STOP_POLICY_OPTIMAL;
+	}
+	if (map->errorBound <= map->valueError)
+	{
+		return STOP_VALUE_ERROR;
+	}
+
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			map->value[i] = scratch[i];
+		}
+	}
+	return STOP_NONE;
+}
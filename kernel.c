@@ -0,0 +1,434 @@
+#include <math.h>
+#include <string.h>
+#include "kernel.h"
+#include "telemetry.h"
+
+// The row kernel backs up a vector of neighbouring cells at once. For each of the eight directions it loads
+// the values one move away, which the ghost border keeps inside the plane at the edges of the grid, and
+// swaps in the cell's own value where the transition table says the move is blocked.
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define KERNEL_NAME "avx512"
+#define KERNEL_WIDTH 16
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define KERNEL_NAME "avx2"
+#define KERNEL_WIDTH 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNEL_NAME "sse2"
+#define KERNEL_WIDTH 4
+#else
+#define KERNEL_NAME "scalar"
+#define KERNEL_WIDTH 1
+#endif
+
+// Name of the instruction set the row kernel was compiled for
+const char *KernelName(void)
+{
+	return KERNEL_NAME;
+}
+
+// Returns whether the running CPU has the instruction set the row kernel was compiled for
+bool KernelSupported(void)
+{
+#if defined(__AVX512F__)
+	return __builtin_cpu_supports("avx512f");
+#elif defined(__AVX2__)
+	return __builtin_cpu_supports("avx2");
+#else
+	// SSE2 is part of x86-64 and the scalar kernel runs anywhere
+	return true;
+#endif
+}
+
+// Backs up one open cell in place of the vector kernel, returns the change in value and counts a changed action in
+// changes
+static inline float BackupScalar(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, size_t i,
+	long long *changes)
+{
+	int best_action;
+	float gap;
+	float old_v = src[i];
+	if (map->cellType[i] != OPEN)
+	{
+		dst[i] = old_v;
+		return 0;
+	}
+	dst[i] = BackupCell(t, map, src, i, &best_action, &gap);
+	if (policy)
+	{
+		*changes += map->action[i] != best_action;
+		map->action[i] = best_action;
+		map->gap[i] = gap;
+	}
+	return fabsf(old_v - dst[i]);
+}
+
+#if defined(__AVX512F__)
+
+// Backs up sixteen cells starting at plane index i, returns the largest change in value, and counts
+// the changed actions in changes
+static inline __m512 BackupVector(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, size_t i,
+	long long *changes)
+{
+	__m512i blocked = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(map->blocked + i)));
+	__m512i collide = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(map->collide + i)));
+	__m512i type = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(map->cellType + i)));
+	__m512 self = _mm512_loadu_ps(src + i);
+	__m512 gamma = _mm512_set1_ps(t->gamma);
+	__m512 collision = _mm512_set1_ps(t->collision);
+	__m512 target[8];
+
+	// Reward plus discounted value of the cell reached by a move in each direction
+	for (int d = 0; d < 8; d++)
+	{
+		__m512i bit = _mm512_set1_epi32(1 << d);
+		__mmask16 stay = _mm512_test_epi32_mask(blocked, bit);
+		__mmask16 hit = _mm512_test_epi32_mask(collide, bit);
+		__m512 next = _mm512_mask_blend_ps(stay, _mm512_loadu_ps(src + i + t->offset[d]), self);
+		__m512 reward = _mm512_mask_blend_ps(hit, _mm512_set1_ps(t->reward[d]), collision);
+		target[d] = _mm512_add_ps(reward, _mm512_mul_ps(gamma, next));
+	}
+
+	// Highest value over the eight actions
+	__m512 left = _mm512_set1_ps(t->probability[0]);
+	__m512 straight = _mm512_set1_ps(t->probability[1]);
+	__m512 right = _mm512_set1_ps(t->probability[2]);
+	__m512 max_v = _mm512_setzero_ps();
+	__m512 second_v = _mm512_set1_ps(-INFINITY);
+	__m512i best_action = _mm512_setzero_si512();
+	for (int action = 0; action < 8; action++)
+	{
+		__m512 new_v = _mm512_mul_ps(left, target[(action + 7) & 7]);
+		new_v = _mm512_add_ps(new_v, _mm512_mul_ps(straight, target[action]));
+		new_v = _mm512_add_ps(new_v, _mm512_mul_ps(right, target[(action + 1) & 7]));
+		if (action == 0)
+		{
+			max_v = new_v;
+			continue;
+		}
+		// The first highest value wins a tie, as in BackupCell
+		__mmask16 higher = _mm512_cmp_ps_mask(new_v, max_v, _CMP_GT_OQ);
+		second_v = _mm512_max_ps(second_v, _mm512_min_ps(new_v, max_v));
+		max_v = _mm512_mask_blend_ps(higher, max_v, new_v);
+		best_action = _mm512_mask_blend_epi32(higher, best_action, _mm512_set1_epi32(action));
+	}
+
+	// Only open cells take the new value
+	__mmask16 open = _mm512_cmpeq_epi32_mask(type, _mm512_set1_epi32(OPEN));
+	__m512 result = _mm512_mask_blend_ps(open, self, max_v);
+	_mm512_storeu_ps(dst + i, result);
+
+	if (policy)
+	{
+		__m512i old_action = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(map->action + i)));
+		best_action = _mm512_mask_blend_epi32(open, old_action, best_action);
+		*changes += __builtin_popcount(_mm512_cmpneq_epi32_mask(old_action, best_action));
+		_mm_storeu_si128((__m128i*)(map->action + i), _mm512_cvtepi32_epi8(best_action));
+		_mm512_storeu_ps(map->gap + i, _mm512_maskz_sub_ps(open, max_v, second_v));
+	}
+
+	return _mm512_abs_ps(_mm512_sub_ps(self, result));
+}
+
+// Backs up the open cells in columns begin to end - 1 of row y, reading values from src and writing them to dst
+float BackupRow(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, int y, int begin, int end)
+{
+	size_t i = MapIndex(map, begin, y);
+	size_t last = i + (end - begin);
+	long long changes = 0;
+	__m512 delta_v = _mm512_setzero_ps();
+	float delta = 0;
+
+	for (; i + KERNEL_WIDTH <= last; i += KERNEL_WIDTH)
+	{
+		delta_v = _mm512_max_ps(delta_v, BackupVector(t, map, src, dst, policy, i, &changes));
+	}
+	delta = _mm512_reduce_max_ps(delta_v);
+
+	// Cells left over at the end of the row
+	for (; i < last; i++)
+	{
+		delta = fmaxf(delta, BackupScalar(t, map, src, dst, policy, i, &changes));
+	}
+
+	TelemetryPolicyChanged(map, changes);
+	return delta;
+}
+
+#elif defined(__AVX2__)
+
+// Widens eight bytes starting at p to eight 32 bit lanes
+static inline __m256i LoadBytes(const uint8_t *p)
+{
+	return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+}
+
+// All bits set in the lanes where bit is set in mask
+static inline __m256 TestBit(__m256i mask, __m256i bit)
+{
+	return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(mask, bit), bit));
+}
+
+// Backs up eight cells starting at plane index i, returns the change in value of each, and counts
+// the changed actions in changes
+static inline __m256 BackupVector(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, size_t i,
+	long long *changes)
+{
+	__m256i blocked = LoadBytes(map->blocked + i);
+	__m256i collide = LoadBytes(map->collide + i);
+	__m256i type = LoadBytes(map->cellType + i);
+	__m256 self = _mm256_loadu_ps(src + i);
+	__m256 gamma = _mm256_set1_ps(t->gamma);
+	__m256 collision = _mm256_set1_ps(t->collision);
+	__m256 target[8];
+
+	// Reward plus discounted value of the cell reached by a move in each direction
+	for (int d = 0; d < 8; d++)
+	{
+		__m256i bit = _mm256_set1_epi32(1 << d);
+		__m256 next = _mm256_blendv_ps(_mm256_loadu_ps(src + i + t->offset[d]), self, TestBit(blocked, bit));
+		__m256 reward = _mm256_blendv_ps(_mm256_set1_ps(t->reward[d]), collision, TestBit(collide, bit));
+		target[d] = _mm256_add_ps(reward, _mm256_mul_ps(gamma, next));
+	}
+
+	// Highest value over the eight actions
+	__m256 left = _mm256_set1_ps(t->probability[0]);
+	__m256 straight = _mm256_set1_ps(t->probability[1]);
+	__m256 right = _mm256_set1_ps(t->probability[2]);
+	__m256 max_v = _mm256_setzero_ps();
+	__m256 second_v = _mm256_set1_ps(-INFINITY);
+	__m256 best_action = _mm256_setzero_ps();
+	for (int action = 0; action < 8; action++)
+	{
+		__m256 new_v = _mm256_mul_ps(left, target[(action + 7) & 7]);
+		new_v = _mm256_add_ps(new_v, _mm256_mul_ps(straight, target[action]));
+		new_v = _mm256_add_ps(new_v, _mm256_mul_ps(right, target[(action + 1) & 7]));
+		if (action == 0)
+		{
+			max_v = new_v;
+			continue;
+		}
+		// The first highest value wins a tie, as in BackupCell
+		__m256 higher = _mm256_cmp_ps(new_v, max_v, _CMP_GT_OQ);
+		second_v = _mm256_max_ps(second_v, _mm256_min_ps(new_v, max_v));
+		max_v = _mm256_blendv_ps(max_v, new_v, higher);
+		best_action = _mm256_blendv_ps(best_action, _mm256_castsi256_ps(_mm256_set1_epi32(action)), higher);
+	}
+
+	// Only open cells take the new value
+	__m256 open = _mm256_castsi256_ps(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(OPEN)));
+	__m256 result = _mm256_blendv_ps(self, max_v, open);
+	_mm256_storeu_ps(dst + i, result);
+
+	if (policy)
+	{
+		__m256 old_action = _mm256_castsi256_ps(LoadBytes(map->action + i));
+		__m256i action = _mm256_castps_si256(_mm256_blendv_ps(old_action, best_action, open));
+		*changes += __builtin_popcount(~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(action,
+			_mm256_castps_si256(old_action)))) & 0xff);
+		// Narrow the eight 32 bit actions back to bytes
+		__m128i action16 = _mm_packs_epi32(_mm256_castsi256_si128(action), _mm256_extracti128_si256(action, 1));
+		_mm_storel_epi64((__m128i*)(map->action + i), _mm_packus_epi16(action16, action16));
+		_mm256_storeu_ps(map->gap + i, _mm256_and_ps(open, _mm256_sub_ps(max_v, second_v)));
+	}
+
+	// Clearing the sign bit gives the absolute change
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	return _mm256_andnot_ps(sign, _mm256_sub_ps(self, result));
+}
+
+// Backs up the open cells in columns begin to end - 1 of row y, reading values from src and writing them to dst
+float BackupRow(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, int y, int begin, int end)
+{
+	size_t i = MapIndex(map, begin, y);
+	size_t last = i + (end - begin);
+	long long changes = 0;
+	__m256 delta_v = _mm256_setzero_ps();
+	float lanes[KERNEL_WIDTH];
+	float delta = 0;
+
+	for (; i + KERNEL_WIDTH <= last; i += KERNEL_WIDTH)
+	{
+		delta_v = _mm256_max_ps(delta_v, BackupVector(t, map, src, dst, policy, i, &changes));
+	}
+	_mm256_storeu_ps(lanes, delta_v);
+	for (int lane = 0; lane < KERNEL_WIDTH; lane++)
+	{
+		delta = fmaxf(delta, lanes[lane]);
+	}
+
+	// Cells left over at the end of the row
+	for (; i < last; i++)
+	{
+		delta = fmaxf(delta, BackupScalar(t, map, src, dst, policy, i, &changes));
+	}
+
+	TelemetryPolicyChanged(map, changes);
+	return delta;
+}
+
+#elif defined(__SSE2__)
+
+// Widens four bytes starting at p to four 32 bit lanes
+static inline __m128i LoadBytes(const uint8_t *p)
+{
+	int32_t bytes;
+	memcpy(&bytes, p, sizeof(bytes));
+	__m128i zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+}
+
+// All bits set in the lanes where bit is set in mask
+static inline __m128 TestBit(__m128i mask, __m128i bit)
+{
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(mask, bit), bit));
+}
+
+// Takes b in the lanes where mask is set and a elsewhere, SSE2 has no blend instruction
+static inline __m128 Select(__m128 a, __m128 b, __m128 mask)
+{
+	return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+// Backs up four cells starting at plane index i, returns the change in value of each, and counts
+// the changed actions in changes
+static inline __m128 BackupVector(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, size_t i,
+	long long *changes)
+{
+	__m128i blocked = LoadBytes(map->blocked + i);
+	__m128i collide = LoadBytes(map->collide + i);
+	__m128i type = LoadBytes(map->cellType + i);
+	__m128 self = _mm_loadu_ps(src + i);
+	__m128 gamma = _mm_set1_ps(t->gamma);
+	__m128 collision = _mm_set1_ps(t->collision);
+	__m128 target[8];
+
+	// Reward plus discounted value of the cell reached by a move in each direction
+	for (int d = 0; d < 8; d++)
+	{
+		__m128i bit = _mm_set1_epi32(1 << d);
+		__m128 next = Select(_mm_loadu_ps(src + i + t->offset[d]), self, TestBit(blocked, bit));
+		__m128 reward = Select(_mm_set1_ps(t->reward[d]), collision, TestBit(collide, bit));
+		target[d] = _mm_add_ps(reward, _mm_mul_ps(gamma, next));
+	}
+
+	// Highest value over the eight actions
+	__m128 left = _mm_set1_ps(t->probability[0]);
+	__m128 straight = _mm_set1_ps(t->probability[1]);
+	__m128 right = _mm_set1_ps(t->probability[2]);
+	__m128 max_v = _mm_setzero_ps();
+	__m128 second_v = _mm_set1_ps(-INFINITY);
+	__m128 best_action = _mm_setzero_ps();
+	for (int action = 0; action < 8; action++)
+	{
+		__m128 new_v = _mm_mul_ps(left, target[(action + 7) & 7]);
+		new_v = _mm_add_ps(new_v, _mm_mul_ps(straight, target[action]));
+		new_v = _mm_add_ps(new_v, _mm_mul_ps(right, target[(action + 1) & 7]));
+		if (action == 0)
+		{
+			max_v = new_v;
+			continue;
+		}
+		// The first highest value wins a tie, as in BackupCell
+		__m128 higher = _mm_cmpgt_ps(new_v, max_v);
+		second_v = _mm_max_ps(second_v, _mm_min_ps(new_v, max_v));
+		max_v = Select(max_v, new_v, higher);
+		best_action = Select(best_action, _mm_castsi128_ps(_mm_set1_epi32(action)), higher);
+	}
+
+	// Only open cells take the new value
+	__m128 open = _mm_castsi128_ps(_mm_cmpeq_epi32(type, _mm_set1_epi32(OPEN)));
+	__m128 result = Select(self, max_v, open);
+	_mm_storeu_ps(dst + i, result);
+
+	if (policy)
+	{
+		__m128 old_action = _mm_castsi128_ps(LoadBytes(map->action + i));
+		__m128i action = _mm_castps_si128(Select(old_action, best_action, open));
+		*changes += __builtin_popcount(~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(action,
+			_mm_castps_si128(old_action)))) & 0xf);
+		// Narrow the four 32 bit actions back to bytes
+		__m128i action16 = _mm_packs_epi32(action, action);
+		int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(action16, action16));
+		memcpy(map->action + i, &bytes, sizeof(bytes));
+		_mm_storeu_ps(map->gap + i, _mm_and_ps(open, _mm_sub_ps(max_v, second_v)));
+	}
+
+	// Clearing the sign bit gives the absolute change
+	__m128 sign = _mm_set1_ps(-0.0f);
+	return _mm_andnot_ps(sign, _mm_sub_ps(self, result));
+}
+
+// Backs up the open cells in columns begin to end - 1 of row y, reading values from src and writing them to dst
+float BackupRow(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, int y, int begin, int end)
+{
+	size_t i = MapIndex(map, begin, y);
+	size_t last = i + (end - begin);
+	long long changes = 0;
+	__m128 delta_v = _mm_setzero_ps();
+	float lanes[KERNEL_WIDTH];
+	float delta = 0;
+
+	for (; i + KERNEL_WIDTH <= last; i += KERNEL_WIDTH)
+	{
+		delta_v = _mm_max_ps(delta_v, BackupVector(t, map, src, dst, policy, i, &changes));
+	}
+	_mm_storeu_ps(lanes, delta_v);
+	for (int lane = 0; lane < KERNEL_WIDTH; lane++)
+	{
+		delta = fmaxf(delta, lanes[lane]);
+	}
+
+	// Cells left over at the end of the row
+	for (; i < last; i++)
+	{
+		delta = fmaxf(delta, BackupScalar(t, map, src, dst, policy, i, &changes));
+	}
+
+	TelemetryPolicyChanged(map, changes);
+	return delta;
+}
+
+#else
+
+// Backs up the open cells in columns begin to end - 1 of row y, reading values from src and writing them to dst
+float BackupRow(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, int y, int begin, int end)
+{
+	size_t i = MapIndex(map, begin, y);
+	size_t last = i + (end - begin);
+	long long changes = 0;
+	float delta = 0;
+
+	for (; i < last; i++)
+	{
+		delta = fmaxf(delta, BackupScalar(t, map, src, dst, policy, i, &changes));
+	}
+
+	TelemetryPolicyChanged(map, changes);
+	return delta;
+}
+
+#endif
+
+// Backs up the open cells in columns begin to end - 1 of row y from right to left, a vector at a time, so in place the
+// values move left along the row as far in one sweep as BackupRow moves them right. Returns the largest change in value.
+float BackupRowReverse(const Transitions *t, const Map *map, const float *src, float *dst, bool policy, int y, int begin,
+	int end)
+{
+	float delta = 0;
+	int x = end;
+	for (; x - KERNEL_WIDTH >= begin; x -= KERNEL_WIDTH)
+	{
+		delta = fmaxf(delta, BackupRow(t, map, src, dst, policy, y, x - KERNEL_WIDTH, x));
+	}
+
+	// Cells left over at the start of the row
+	for (; x > begin; x--)
+	{
+		delta = fmaxf(delta, BackupRow(t, map, src, dst, policy, y, x - 1, x));
+	}
+
+	return delta;
+}
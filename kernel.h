@@ -0,0 +1,89 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <math.h>
+#include "valuefunction.h"
+
+// Value of one cell under a single action using the values in src
+static inline float EvaluateCell(const Transitions *t, const Map *map, const float *src, size_t i, int action)
+{
+	float target[3];
+
+	// Probability that action is diverted to the either side, therefore three actions instead of one
+	for (int k = 0; k < 3; k++)
+	{
+		// New actions loop around to stay between 0 and 7
+		int d = (action + k + 7) & 7;
+		// Blocked moves stay in the cell, moves into an obstruction take the collision penalty
+		size_t next = map->blocked[i] >> d & 1 ? i : i + t->offset[d];
+		float reward = map->collide[i] >> d & 1 ? t->collision : t->reward[d];
+		target[k] = reward + t->gamma * src[next];
+	}
+
+	// Summed in the same order as BackupCell so both give the same value for the same action
+	float new_v = t->probability[0] * target[0];
+	new_v = new_v + t->probability[1] * target[1];
+	new_v = new_v + t->probability[2] * target[2];
+
+	return new_v;
+}
+
+// Backs up one cell for all eight actions using the values in src, returns the highest value and stores the corresponding
+// action, and the action gap between the highest and second highest value if gap is not NULL
+static inline float BackupCell(const Transitions *t, const Map *map, const float *src, size_t i, int *best_action, float *gap)
+{
+	uint8_t blocked = map->blocked[i];
+	uint8_t collide = map->collide[i];
+	float target[8];
+	float max_v = 0;
+	float second_v = -INFINITY;
+
+	// Reward plus discounted value of the cell reached by a move in each direction
+	for (int d = 0; d < 8; d++)
+	{
+		size_t next = blocked >> d & 1 ? i : i + t->offset[d];
+		float reward = collide >> d & 1 ? t->collision : t->reward[d];
+		target[d] = reward + t->gamma * src[next];
+	}
+
+	// Each action combines its own direction with the two directions either side
+	for (int action = 0; action < 8; action++)
+	{
+		float new_v = t->probability[0] * target[(action + 7) & 7];
+		new_v = new_v + t->probability[1] * target[action];
+		new_v = new_v + t->probability[2] * target[(action + 1) & 7];
+
+		// First or highest value stored in max_v along with corresponding action
+		if (action == 0 || new_v > max_v)
+		{
+			second_v = action == 0 ? second_v : max_v;
+			max_v = new_v;
+			*best_action = action;
+		}
+		else if (new_v > second_v)
+		{
+			second_v = new_v;
+		}
+	}
+
+	if (gap != NULL)
+	{
+		*gap = max_v - second_v;
+	}
+
+	return max_v;
+}
+
+// Backs up the open cells in columns begin to end - 1 of row y, reading values from src and writing them to dst
+// src and dst may be the same plane for an in-place sweep. If policy is set the best action and action gap of
+// each cell are written to the map's action and gap planes as well. Returns the largest change in value.
+float BackupRow(const Transitions*, const Map*, const float *src, float *dst, bool policy, int y, int begin, int end);
+// Backs up the cells as BackupRow does, but a vector at a time from the right end of the columns to the left
+float BackupRowReverse(const Transitions*, const Map*, const float *src, float *dst, bool policy, int y, int begin, int end);
+// Name of the instruction set the row kernel was compiled for
+const char *KernelName(void);
+// Returns whether the running CPU has the instruction set the row kernel was compiled for. The set is picked when the
+// library is built, so a build with -march=native does not run on a CPU without the build machine's widest set.
+bool KernelSupported(void);
+
+#endif
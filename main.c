@@ -1,181 +1,317 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
-// clang -o main main.c libraylib.a -framework IOKit -framework Cocoa -framework OpenGL
-// ./main
+// make main
+// ./main [cols rows [seed]]
 #include "raylib.h"
 #include "raymath.h"
+#include "valuefunction.h"
+#include "background.h"
 
-// Map dimensions
-#define COLS 20
-#define ROWS 20
-
-// Cell property
-typedef enum CellType
-{
-	OPEN, // Free movement through cell
-	GOAL, // Destination
-	HOLE, // Should be avoided
-    	OBSTRUCTION // Wall
-} CellType;
-
-// Contains information about each cell
-typedef struct Cell
-{
-	int x;
-	int y; // Position
-	CellType cellType; // Cell property
-	float value; // Desirability of location in cell
-	int action; // Integer represents best direction to move out of cell, clockwise with 0 at top
-} Cell;
-
-// Information about map
-typedef struct Map
+// Grid drawn into a texture once and kept between frames, with what each cell showed when it was last drawn, so a frame
+// only redraws the cells that changed and then draws the texture as one quad
+typedef struct GridCache
 {
-	float theta; // Sets ccuracy of estimation and tests for covergence, loop until value of change less than theta or max iterations
-	float probability; // Probability of moving to the correct cell, models uncertainty in action
-	// Example: If probability = 0.9, and chosen action is to move right, there is a 0.05 chance it moves top right
-	// and a 0.05 chance it moves bottom right.
-	float gamma; // Discount factor
-	Cell grid[COLS][ROWS];
-	int max_iterations; // Maximum number of loops
-	int movementPenalty; // Cost of movement
-	int collisionPenalty; // Cost of colliding with wall
-    	int cellWidth;
-	int cellHeight;
-} Map;
-
-// Draws cell borders, interior colour and value to screen
-void CellDraw(Cell*, int, int);
+	RenderTexture2D texture;
+	float *value; // Value each cell was last drawn with
+	uint8_t *action; // Action each cell was last drawn with
+	uint8_t *cellType; // Cell type each cell was last drawn with
+	bool stale; // Every cell has to be drawn again, set before the first frame and when the map is reset
+	bool drawing; // The texture is the current render target
+} GridCache;
+
+// Creates the texture and the record of what was drawn for a map, returns false if either could not be allocated
+bool GridCacheInit(GridCache*, const Map*, int, int);
+// Redraws the cell at column x and row y into the texture if it would show something other than it last did
+void GridCacheCell(GridCache*, Map*, const float*, const uint8_t*, int, int, int, int);
+// Redraws every cell that changed since it was last drawn
+void GridCacheUpdate(GridCache*, Map*, const float*, const uint8_t*, int, int);
+// Releases the texture and the record
+void GridCacheFree(GridCache*);
+// Draws cell borders, interior colour and value to screen, open cells take their value and action from the planes given
+void CellDraw(Map*, const float*, const uint8_t*, int, int, int, int);
 // Draws direction arrow in cell to screen
-void DrawDirections(Cell*, int, int);
-// Checks that the index is suitable
-bool IndexIsValid(int, int);
-// Cycles a cell through the different cell types
-void ChangeCellType(Cell*);
-// Initialises each grid and adds random obstacles
-void GridInit(Map*);
-// Initialises the map
-void MapInit(Map*);
-// Value Iteration function calls the two following functions
-void ValueIteration(Map*);
-// Loops through grid updating cell values
-void ComputeValueFunction(Map*);
-// Calculates best action to take given surrounding cell values
-void ExtractPolicy(Map*);
-// Calculates new cell value
-float CalculateValue(Map*, int, int, int);
-
-int main()
+void DrawDirections(int, int, int, int, int);
+
+int main(int argc, char **argv)
 {
-	// Generate random seed
-	srand(time(0));
+	// Generate random seed, unless one is given to repeat a map
+	srand(argc > 3 ? (unsigned int)strtoul(argv[3], NULL, 10) : (unsigned int)time(0));
+
+	// Map size can be given on the command line
+	int cols = argc > 2 ? atoi(argv[1]) : COLS;
+	int rows = argc > 2 ? atoi(argv[2]) : ROWS;
 
 	int screenWidth = 760;
 	int screenHeight = 760;
 
     	Map map;
 
-    	map.cellWidth = screenWidth / COLS;
-	map.cellHeight = screenHeight / ROWS;
+	if (!MapAlloc(&map, cols, rows))
+	{
+		fprintf(stderr, "Could not allocate a %d x %d map\n", cols, rows);
+		return 1;
+	}
+
+	// Cells are at least one pixel, the window shrinks to fit the grid
+	int cellWidth = screenWidth / cols > 0 ? screenWidth / cols : 1;
+	int cellHeight = screenHeight / rows > 0 ? screenHeight / rows : 1;
+	screenWidth = cellWidth * cols;
+	screenHeight = cellHeight * rows;
+
+	// Solves run on their own thread so the window keeps drawing and taking edits
+	BackgroundSolver solver;
+
+	if (!BackgroundSolverInit(&solver, cols, rows))
+	{
+		fprintf(stderr, "Could not start the solver for a %d x %d map\n", cols, rows);
+		MapFree(&map);
+		return 1;
+	}
+
+	// Id of the last solve requested, and of the first one since the map was last reset
+	unsigned long request = 0;
+	unsigned long first = 1;
 
 	// Create window
 	InitWindow(screenWidth, screenHeight, "Value Iteration");
+	SetTargetFPS(60);
 
 	MapInit(&map);
+
+	// The texture needs the window's graphics context
+	GridCache cache;
+	if (!GridCacheInit(&cache, &map, screenWidth, screenHeight))
+	{
+		fprintf(stderr, "Could not allocate the grid texture for a %d x %d map\n", cols, rows);
+		CloseWindow();
+		BackgroundSolverFree(&solver);
+		MapFree(&map);
+		return 1;
+	}
+	// Snapshot the cells were last checked against, the values only change with a new one or an edit
+	const Snapshot *shown = NULL;
 	
 	while(!WindowShouldClose())
 	{
+		// Cell edited this frame, none if negative
+		int editX = -1;
+		int editY = -1;
+
 		// A left mouse click cycles through cell types
 		if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
 		{
 			Vector2 mPos = GetMousePosition();
-			int x = mPos.x / map.cellWidth;
-			int y = mPos.y / map.cellHeight;
+			int x = mPos.x / cellWidth;
+			int y = mPos.y / cellHeight;
 
-            		if (IndexIsValid(x, y))
+            		if (IndexIsValid(&map, x, y))
 			{
-				ChangeCellType(&map.grid[x][y]);
+				ChangeCellType(&map, x, y);
+				editX = x;
+				editY = y;
 			}
 
 		}
 
-		// The space bar starts the value iteration process
+		// The space bar starts the value iteration process, after the first solve only the edited area is re-solved
 		if (IsKeyPressed(KEY_SPACE))
 		{
-			ValueIteration(&map);
+			request = BackgroundSolverPost(&solver, &map);
 		}
 
-		// The R key resets the map
+		// The R key resets the map, hiding the values of earlier solves
 		if (IsKeyPressed(KEY_R))
 		{
 			MapInit(&map);
+			first = request + 1;
+			cache.stale = true;
+		}
+
+		// Latest values published by the solver, they show the solve's progress until it finishes
+		const Snapshot *snapshot = BackgroundSolverLatest(&solver);
+		const float *value = map.value;
+		const uint8_t *action = map.action;
+		if (snapshot != NULL && snapshot->request >= first)
+		{
+			value = snapshot->value;
+			action = snapshot->action;
+		}
+
+		// Only cells whose values, actions or types changed are drawn again, every cell is checked when the solver
+		// publishes, otherwise only an edited one
+		if (snapshot != shown || cache.stale)
+		{
+			GridCacheUpdate(&cache, &map, value, action, cellWidth, cellHeight);
+			shown = snapshot;
+		}
+		else if (editX >= 0)
+		{
+			GridCacheCell(&cache, &map, value, action, editX, editY, cellWidth, cellHeight);
+		}
+		if (cache.drawing)
+		{
+			EndTextureMode();
+			cache.drawing = false;
 		}
 
 		BeginDrawing();
 
 	        ClearBackground(RAYWHITE);
 
-		// Draw each cell in the grid
-	        for (int x = 0; x < COLS; x++)
-	        {
-	            for (int y = 0; y < ROWS; y++)
-	            {
-	                CellDraw(&map.grid[x][y], map.cellWidth, map.cellHeight);
-	            }
-	        }
+		// Render textures are stored bottom up, so the grid is drawn flipped
+		DrawTextureRec(cache.texture.texture, (Rectangle){ 0, 0, screenWidth, -screenHeight }, (Vector2){ 0, 0 }, WHITE);
+
+		// Until the latest request is solved
+		if (request >= first && (snapshot == NULL || snapshot->request != request || !snapshot->done))
+		{
+			DrawText("Solving", 10, 10, 20, RED);
+		}
 
 		EndDrawing();
 	}
 	
+	GridCacheFree(&cache);
 	CloseWindow();
+
+	BackgroundSolverFree(&solver);
+	MapFree(&map);
 	
 	return 0;
 }
 
-// Draws cell borders, interior colour and value to screen
-void CellDraw(Cell *cell, int cellWidth, int cellHeight)
+// Creates the texture and the record of what was drawn for a map, returns false if either could not be allocated
+bool GridCacheInit(GridCache *cache, const Map *map, int width, int height)
+{
+	size_t cells = MapPlaneLength(map);
+	cache->texture = LoadRenderTexture(width, height);
+	cache->value = malloc(cells * sizeof(float));
+	cache->action = malloc(cells * sizeof(uint8_t));
+	cache->cellType = malloc(cells * sizeof(uint8_t));
+	cache->stale = true;
+	cache->drawing = false;
+	if (cache->texture.id == 0 || cache->value == NULL || cache->action == NULL || cache->cellType == NULL)
+	{
+		GridCacheFree(cache);
+		return false;
+	}
+
+	// Cells only ever cover their own rectangle, so the background is cleared once
+	BeginTextureMode(cache->texture);
+	ClearBackground(RAYWHITE);
+	EndTextureMode();
+	return true;
+}
+
+// Redraws the cell at column x and row y into the texture if it would show something other than it last did
+void GridCacheCell(GridCache *cache, Map *map, const float *value, const uint8_t *action, int x, int y, int cellWidth,
+	int cellHeight)
+{
+	size_t i = MapIndex(map, x, y);
+	// The same choice of plane as CellDraw makes
+	float v = map->cellType[i] == OPEN ? value[i] : map->value[i];
+	uint8_t a = map->cellType[i] == OPEN ? action[i] : map->action[i];
+	if (!cache->stale && v == cache->value[i] && a == cache->action[i] && map->cellType[i] == cache->cellType[i])
+	{
+		return;
+	}
+	cache->value[i] = v;
+	cache->action[i] = a;
+	cache->cellType[i] = map->cellType[i];
+
+	// The texture stays the render target until the frame is drawn, so a whole sweep's changes go in one batch
+	if (!cache->drawing)
+	{
+		BeginTextureMode(cache->texture);
+		cache->drawing = true;
+	}
+	CellDraw(map, value, action, x, y, cellWidth, cellHeight);
+}
+
+// Redraws every cell that changed since it was last drawn
+void GridCacheUpdate(GridCache *cache, Map *map, const float *value, const uint8_t *action, int cellWidth,
+	int cellHeight)
+{
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			GridCacheCell(cache, map, value, action, x, y, cellWidth, cellHeight);
+		}
+	}
+	cache->stale = false;
+}
+
+// Releases the texture and the record
+void GridCacheFree(GridCache *cache)
+{
+	if (cache->texture.id != 0)
+	{
+		UnloadRenderTexture(cache->texture);
+	}
+	free(cache->value);
+	free(cache->action);
+	free(cache->cellType);
+}
+
+// Draws cell borders, interior colour and value to screen, open cells take their value and action from the planes given
+// A value too wide for the cell is clipped to it, so a redrawn cell never leaves text over its neighbours
+void CellDraw(Map *map, const float *value, const uint8_t *action, int col, int row, int cellWidth, int cellHeight)
 {
 	int font = 12;
-	if (cell->cellType == OBSTRUCTION) // Obstructions are purple
+	size_t i = MapIndex(map, col, row);
+	// Goals and holes keep the value of the map, which is up to date with the latest edits
+	float v = map->cellType[i] == OPEN ? value[i] : map->value[i];
+	int a = map->cellType[i] == OPEN ? action[i] : map->action[i];
+	if (map->cellType[i] == OBSTRUCTION) // Obstructions are purple
 	{
-	DrawRectangle(cell->x * cellWidth, cell->y * cellHeight, cellWidth, cellHeight, PURPLE);
+	DrawRectangle(col * cellWidth, row * cellHeight, cellWidth, cellHeight, PURPLE);
 	}
 	else
 	{
-		if (cell->cellType == GOAL) // Goals are yellow
+		if (map->cellType[i] == GOAL) // Goals are yellow
 		{
-			DrawRectangle(cell->x * cellWidth, cell->y * cellHeight, cellWidth, cellHeight, (Color){255, 255, 125, 255 } );
+			DrawRectangle(col * cellWidth, row * cellHeight, cellWidth, cellHeight, (Color){255, 255, 125, 255 } );
 		}
-		else if (cell->cellType == HOLE) // Holes are green
+		else if (map->cellType[i] == HOLE) // Holes are green
 		{
-			DrawRectangle(cell->x * cellWidth, cell->y * cellHeight, cellWidth, cellHeight, (Color){55, 125, 100, 255 } );
+			DrawRectangle(col * cellWidth, row * cellHeight, cellWidth, cellHeight, (Color){55, 125, 100, 255 } );
 		}
 		else // Open cells are given a value on a gradient depending on their value
 		{
 			int max = 100;
 			int min = -100;
-			int r = 55 + 200*((cell->value-min)/(max-min));
-			int g = 125 + 130*((cell->value-min)/(max-min));
-			int b = 100 + 25*((cell->value-min)/(max-min));
+			int r = 55 + 200*((v-min)/(max-min));
+			int g = 125 + 130*((v-min)/(max-min));
+			int b = 100 + 25*((v-min)/(max-min));
 			r = r < 55 ? 55 : r;
 			g = g < 125 ? 125 : g;
 			b = b < 100 ? 100 : b;
-			DrawRectangle(cell->x * cellWidth, cell->y * cellHeight, cellWidth, cellHeight, (Color){r, g, b, 255 } );
+			DrawRectangle(col * cellWidth, row * cellHeight, cellWidth, cellHeight, (Color){r, g, b, 255 } );
 		}
 		// Draw arrows
-		DrawDirections(cell, cellWidth, cellHeight);
+		DrawDirections(a, col, row, cellWidth, cellHeight);
 		// Write value on cell
-		DrawText(TextFormat("%0.1f",cell->value), (cell->x + 0.1f) * cellWidth, (cell->y + 0.3f) * cellHeight, font, DARKGRAY);
+		const char *text = TextFormat("%0.1f",v);
+		bool clip = 0.1f * cellWidth + MeasureText(text, font) > cellWidth;
+		if (clip)
+		{
+			BeginScissorMode(col * cellWidth, row * cellHeight, cellWidth, cellHeight);
+		}
+		DrawText(text, (col + 0.1f) * cellWidth, (row + 0.3f) * cellHeight, font, DARKGRAY);
+		if (clip)
+		{
+			EndScissorMode();
+		}
 	}
 	// Draw borders
-	DrawRectangleLines(cell->x * cellWidth, cell->y * cellHeight, cellWidth, cellHeight, BLACK);
+	DrawRectangleLines(col * cellWidth, row * cellHeight, cellWidth, cellHeight, BLACK);
 }
 
 // Draws direction arrow in cell to screen
-void DrawDirections(Cell *cell, int cellWidth, int cellHeight)
+void DrawDirections(int action, int col, int row, int cellWidth, int cellHeight)
 {
-	if (cell->action == 8) // Action initially set to 8, no direction
+	if (action == 8) // Action initially set to 8, no direction
 	{
 	}
 	else
@@ -184,52 +320,52 @@ void DrawDirections(Cell *cell, int cellWidth, int cellHeight)
 		int y;
 		Vector2 start;
 		Vector2 end;
-		if (cell->action == 0) // Point up
+		if (action == 0) // Point up
 		{
-			x = cell->x*cellWidth + cellWidth/2;
-			y = cell->y*cellHeight + cellHeight/4;
+			x = col*cellWidth + cellWidth/2;
+			y = row*cellHeight + cellHeight/4;
 			end = (Vector2){x, y + 0.65*cellHeight};
 		}
-		else if (cell->action == 1) // Point up and right
+		else if (action == 1) // Point up and right
 		{
-			x = cell->x*cellWidth + 3*cellWidth/4;
-			y = cell->y*cellHeight + cellHeight/4;
+			x = col*cellWidth + 3*cellWidth/4;
+			y = row*cellHeight + cellHeight/4;
 			end = (Vector2){x - 0.53*cellWidth, y + 0.53*cellHeight};
 		}
-		else if (cell->action == 2) // Point right
+		else if (action == 2) // Point right
 		{
-			x = cell->x*cellWidth + 3*cellWidth/4;
-			y = cell->y*cellHeight + cellHeight/2;
+			x = col*cellWidth + 3*cellWidth/4;
+			y = row*cellHeight + cellHeight/2;
 			end = (Vector2){x - 0.65*cellHeight, y};
 		}
-		else if (cell->action == 3) // Point down and right
+		else if (action == 3) // Point down and right
 		{
-			x = cell->x*cellWidth + 3*cellWidth/4;
-			y = cell->y*cellHeight + 3*cellHeight/4;
+			x = col*cellWidth + 3*cellWidth/4;
+			y = row*cellHeight + 3*cellHeight/4;
 			end = (Vector2){x - 0.53*cellWidth, y - 0.53*cellHeight};
 		}
-		else if (cell->action == 4) // Point down
+		else if (action == 4) // Point down
 		{
-			x = cell->x*cellWidth + cellWidth/2;
-			y = cell->y*cellHeight + 3*cellHeight/4;
+			x = col*cellWidth + cellWidth/2;
+			y = row*cellHeight + 3*cellHeight/4;
 			end = (Vector2){x, y - 0.65*cellHeight};
 		}
-		else if (cell->action == 5) // Point down and left
+		else if (action == 5) // Point down and left
 		{
-			x = cell->x*cellWidth + cellWidth/4;
-			y = cell->y*cellHeight + 3*cellHeight/4;
+			x = col*cellWidth + cellWidth/4;
+			y = row*cellHeight + 3*cellHeight/4;
 			end = (Vector2){x + 0.53*cellWidth, y - 0.53*cellHeight};
 		}
-		else if (cell->action == 6) // Point left
+		else if (action == 6) // Point left
 		{
-			x = cell->x*cellWidth + cellWidth/4;
-			y = cell->y*cellHeight + cellHeight/2;
+			x = col*cellWidth + cellWidth/4;
+			y = row*cellHeight + cellHeight/2;
 			end = (Vector2){x + 0.65*cellHeight, y};
 		}
-		else if (cell->action == 7) // Point up and left
+		else if (action == 7) // Point up and left
 		{
-			x = cell->x*cellWidth + cellWidth/4;
-			y = cell->y*cellHeight + cellHeight/4;
+			x = col*cellWidth + cellWidth/4;
+			y = row*cellHeight + cellHeight/4;
 			end = (Vector2){x + 0.53*cellWidth, y + 0.53*cellHeight};
 		}
 		start = (Vector2){x,y};
@@ -238,297 +374,3 @@ void DrawDirections(Cell *cell, int cellWidth, int cellHeight)
 		DrawLineEx(start, end, 2, RED);
 	}
 }
-
-// Cycles a cell through the different cell types
-void ChangeCellType(Cell *cell)
-{
-    if (cell->cellType == OPEN)
-    {
-        cell->cellType = GOAL;
-	cell->value = 100; // Goals have a high value
-    }
-    else if (cell->cellType == GOAL)
-    {
-        cell->cellType = HOLE;
-	cell->value = -100; // Holes have a low value
-    }
-    else if (cell->cellType == HOLE)
-    {
-        cell->cellType = OBSTRUCTION;
-	cell->value = 0;
-    }
-    else if (cell->cellType == OBSTRUCTION)
-    {
-        cell->cellType = OPEN;
-    }
-}
-
-// Checks that the index is suitable
-bool IndexIsValid(int x, int y)
-{
-	return x >= 0 && x < COLS && y >= 0 && y < ROWS;
-}
-
-// Initialises each grid and adds random obstacles
-void GridInit(Map *map)
-{
-	for (int x = 0; x < COLS; x++)
-	{
-		for (int y = 0; y < ROWS; y++)
-		{
-			map->grid[x][y] = (Cell) // Gives initial value to each cell
-			{
-				.x = x,
-				.y = y,
-                		.cellType = OPEN,
-				.value = 0,
-				.action = 8
-			};
-		}
-	}
-
-	// Randomly adds obstacles
-	int obstaclesPresent = (int)(ROWS * COLS * 0.1f);
-	int obstaclesToPlace = obstaclesPresent;
-	while (obstaclesToPlace > 0)
-	{
-		int x = rand() % COLS;
-		int y = rand() % ROWS;
-
-		if (map->grid[x][y].cellType == OPEN)
-		{
-			map->grid[x][y].cellType = OBSTRUCTION;
-			obstaclesToPlace--;
-		}
-	}
-}
-
-// Initialises the map
-void MapInit(Map *map)
-{
-	map->theta = 1e-6;
-	map->probability = 0.8;
-	map->gamma = 1;
-	map->max_iterations = 100;
-	map->movementPenalty = -10;
-	map->collisionPenalty = -50;
-	GridInit(map);
-}
-
-void ValueIteration(Map *map)
-{
-	// Value function calculated first
-	ComputeValueFunction(map);
-	// Then optimal actions are found
-	ExtractPolicy(map);
-}
-
-// Loops through grid updating cell values
-void ComputeValueFunction(Map *map)
-{
-	bool loop = true;
-	float old_v;
-	float new_v;
-	float max_v;
-	float delta;
-	int iterations = 0;
-    
-	while (loop == true)
-	{
-		printf("%d\n",iterations);
-		delta = 0;
-		// Sweep systematically over the cells
-		for (int x = 0; x < COLS; x++)
-		{
-			for (int y = 0; y < ROWS; y++)
-			{	
-				// Skip obstructions, holes and goals
-				if (map->grid[x][y].cellType == OPEN)
-				{
-					// Store the previous value
-					old_v = map->grid[x][y].value;
-					max_v = 0;
-					// Loop over all eight actions
-					for (int action = 0; action < 8; action++)
-					{
-						// Calculate a new value given the action
-						new_v = CalculateValue(map, action, x, y);
-
-						// First or highest value stored in max_v
-						if (action == 0 || new_v > max_v)
-						{
-							max_v = new_v;
-						}
-
-					}
-					
-					// New value is the maximum value
-					map->grid[x][y].value = max_v;
-
-					// Update the maximum deviation
-					if (fabsf(old_v - max_v) > delta)
-					{
-						delta = fabsf(old_v - max_v);
-					}
-
-					// Update the cell on screen
-					BeginDrawing();
-
-					CellDraw(&map->grid[x][y], map->cellWidth, map->cellHeight);
-
-					EndDrawing();
-
-				}
-			}
-		}
-
-		// Increment iteration count
-		iterations += 1;
-
-		// Terminate the loop if the change was very small -> convergence
-		if (delta < map->theta)
-		{
-			loop = false;
-		}
-		
-		// Terminate the loop if the maximum number of iterations is met
-		if (iterations > map->max_iterations)
-		{
-			loop = false;
-		}
-	}
-}
-
-// Calculates best action to take given surrounding cell values
-void ExtractPolicy(Map *map)
-{
-	int best_action;
-	float old_v;
-	float new_v;
-	float max_v;
-	float delta;
-	// Sweep systematically over the cells
-	for (int x = 0; x < COLS; x++)
-	{
-		for (int y = 0; y < ROWS; y++)
-		{	
-			// Skip obstructions, holes and goals
-			if (map->grid[x][y].cellType == OPEN)
-			{
-				// Store the previous value
-				old_v = map->grid[x][y].value;
-				max_v = 0;
-				// Loop over all eight actions
-				for (int action = 0; action < 8; action++)
-				{
-					// Calculate a new value given the action
-					new_v = CalculateValue(map, action, x, y);
-
-					// First or highest value stored in max_v along with corresponding action
-					if (action == 0 || new_v > max_v)
-					{
-						max_v = new_v;
-						best_action = action;
-					}
-
-				}
-				// Best action is the action that corresponds with the maximum value
-				map->grid[x][y].action = best_action;
-			}
-		}
-	}
-}
-
-// Calculates new cell value
-float CalculateValue(Map *map, int action, int x, int y)
-{
-	float new_probability;
-	int new_x;
-	int new_y;
-	int new_reward;
-	int new_action;
-	float new_v = 0;
-
-	// Probability that action is diverted to the either side, therefore three actions instead of one
-	for (int i = -1; i < 2; i++)
-	{
-		if (i == 0) // Correct action
-		{
-			new_probability = map->probability;
-		}
-		else // Sideways action
-		{
-			new_probability = (1 - map->probability)/2;
-		}
-
-		new_action = action + i;
-
-		// New actions loop around to stay between 0 and 7
-		if (new_action == 8)
-		{
-			new_action = 0;
-		}
-		else if (new_action == -1)
-		{
-			new_action = 7;
-		}
-
-		// Find new cell position given action
-		if (new_action > 0 && new_action < 4)
-		{
-			new_x = x + 1;
-		}
-		else if (new_action > 4)
-		{
-			new_x = x - 1;
-		}
-		else
-		{
-			new_x = x;
-		}
-
-		if (new_action < 2 || new_action > 6)
-		{
-			new_y = y - 1;
-		}
-		else if (new_action > 2 && new_action < 6)
-		{
-			new_y = y + 1;
-		}
-		else
-		{
-			new_y = y;
-		}
-
-		// If the new cell position is in the grid
-		if (IndexIsValid(new_x, new_y))
-		{
-			// If the new cell position is an obstruction give collision penalty to reward and do not change position
-			if (map->grid[new_x][new_y].cellType == OBSTRUCTION)
-			{
-				new_reward = map->collisionPenalty;
-				new_x = x;
-				new_y = y;
-			}
-			else
-			{
-				// If both the x and y position are changed, apply a larger 1.4 * diagonal movement penalty,
-				// otherwise apply a normal 1 * movement penalty
-				new_reward = new_x != x && new_y != y ? 1.4 * map->movementPenalty : map->movementPenalty;
-			}
-		}
-		else // If the new cell position is off the grid, apply movement penalty to reward but do not change position
-		{
-			new_reward = new_x != x && new_y != y ? 1.4 * map->movementPenalty : map->movementPenalty;
-			new_x = x;
-			new_y = y;
-		}
-
-		// Collect values from different actions to calculate the new value using the Bellman equation
-		new_v = new_v + new_probability * (new_reward + map->gamma * map->grid[new_x][new_y].value);
-
-	}
-	
-	// Return the new value
-	return new_v;
-}
@@ -0,0 +1,216 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapfile.h"
+
+// First bytes of every map file
+static const char mapFileMagic[8] = { 'V', 'A', 'L', 'U', 'E', 'M', 'A', 'P' };
+
+// Returns the file offset of a plane of a map whose plane block follows a header of the given size
+static uint64_t PlaneOffset(const Map *map, const void *plane, uint32_t headerSize)
+{
+	return headerSize + (uint64_t)((uintptr_t)plane - (uintptr_t)map->memory);
+}
+
+// Fills a header describing the map, its plane block following the header padded to headerSize
+static void MapFileHeaderFill(MapFileHeader *header, const Map *map, uint32_t headerSize)
+{
+	memset(header, 0, sizeof(MapFileHeader));
+	memcpy(header->magic, mapFileMagic, sizeof(mapFileMagic));
+	header->version = MAP_FILE_VERSION;
+	header->headerSize = headerSize;
+	header->byteOrder = MAP_FILE_BYTE_ORDER;
+	header->flags = map->solved ? MAP_FILE_SOLVED : 0;
+	header->width = map->width;
+	header->height = map->height;
+	header->stride = map->stride;
+	header->theta = map->theta;
+	header->probability = map->probability;
+	header->gamma = map->gamma;
+	header->maxIterations = map->max_iterations;
+	header->movementPenalty = map->movementPenalty;
+	header->collisionPenalty = map->collisionPenalty;
+	header->valueOffset = PlaneOffset(map, map->value, headerSize);
+	header->gapOffset = PlaneOffset(map, map->gap, headerSize);
+	header->cellTypeOffset = PlaneOffset(map, map->cellType, headerSize);
+	header->actionOffset = PlaneOffset(map, map->action, headerSize);
+	header->blockedOffset = PlaneOffset(map, map->blocked, headerSize);
+	header->collideOffset = PlaneOffset(map, map->collide, headerSize);
+	header->fileSize = headerSize + (uint64_t)MapBlockSize(map->width, map->height);
+}
+
+// Writes all of a buffer, retrying the partial writes a large buffer may need, returns false on an error
+static bool WriteAll(int file, const void *data, size_t size)
+{
+	const uint8_t *next = data;
+	while (size > 0)
+	{
+		ssize_t written = write(file, next, size);
+		if (written < 0)
+		{
+			return false;
+		}
+		next += written;
+		size -= (size_t)written;
+	}
+	return true;
+}
+
+// Writes the grid, parameters, values and actions of a map to a new file, the plane block is written as it is held
+// in memory. Returns false if the file could not be written. A map loaded from the same file is kept up to date by
+// MapSync instead.
+bool MapSave(const Map *map, const char *path)
+{
+	if (map->memory == NULL)
+	{
+		return false;
+	}
+
+	// The header is padded with zeros up to the first plane
+	static_assert(sizeof(MapFileHeader) <= MAP_FILE_HEADER_SIZE, "map file header does not fit");
+	uint8_t header[MAP_FILE_HEADER_SIZE] = { 0 };
+	MapFileHeaderFill((MapFileHeader*)header, map, MAP_FILE_HEADER_SIZE);
+
+	int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+	{
+		return false;
+	}
+	bool ok = WriteAll(file, header, sizeof(header)) &&
+		WriteAll(file, map->memory, MapBlockSize(map->width, map->height));
+	return close(file) == 0 && ok;
+}
+
+// Returns whether a mapped header describes a file of the given size, laid out as MapFileHeaderFill describes it
+static bool MapFileHeaderValid(const MapFileHeader *header, size_t size)
+{
+	if (memcmp(header->magic, mapFileMagic, sizeof(mapFileMagic)) != 0 || header->version != MAP_FILE_VERSION ||
+		header->byteOrder != MAP_FILE_BYTE_ORDER || header->headerSize < sizeof(MapFileHeader) ||
+		header->headerSize % MAP_ALIGNMENT != 0 || header->width <= 0 || header->height <= 0 ||
+		header->width > INT32_MAX - 2 || header->height > INT32_MAX - 2 || header->stride != header->width + 2 ||
+		header->fileSize != size ||
+		header->fileSize != header->headerSize + (uint64_t)MapBlockSize(header->width, header->height))
+	{
+		return false;
+	}
+
+	// Every plane has to be where MapAttach puts it, so the map can point into the file as it is
+	Map layout;
+	MapAttach(&layout, header->width, header->height, (uint8_t*)header + header->headerSize);
+	return header->valueOffset == PlaneOffset(&layout, layout.value, header->headerSize) &&
+		header->gapOffset == PlaneOffset(&layout, layout.gap, header->headerSize) &&
+		header->cellTypeOffset == PlaneOffset(&layout, layout.cellType, header->headerSize) &&
+		header->actionOffset == PlaneOffset(&layout, layout.action, header->headerSize) &&
+		header->blockedOffset == PlaneOffset(&layout, layout.blocked, header->headerSize) &&
+		header->collideOffset == PlaneOffset(&layout, layout.collide, header->headerSize);
+}
+
+// Checks that every cell of the grid has a known type and action, then makes the ghost border obstructions as GridClear
+// does, since the solvers and the searches walk the plane until they meet one. Returns false, changing nothing, if a
+// cell is out of range.
+static bool MapPlanesValid(Map *map)
+{
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] > OBSTRUCTION || map->action[i] > 8)
+			{
+				return false;
+			}
+		}
+	}
+
+	size_t cells = MapPlaneLength(map);
+	for (size_t i = 0; i < cells; i++)
+	{
+		size_t x = i % map->stride;
+		size_t y = i / map->stride;
+		if (x == 0 || x > (size_t)map->width || y == 0 || y > (size_t)map->height)
+		{
+			map->cellType[i] = OBSTRUCTION;
+			map->value[i] = 0;
+			map->gap[i] = 0;
+			map->action[i] = 8;
+		}
+	}
+	return true;
+}
+
+// Maps a map file into memory and points the map's planes straight into it, nothing is copied. The cells are checked
+// and the ghost border is made obstructions. With shared set, solving the map writes its values and actions through to
+// the file, otherwise the file is left unchanged and pages are copied only as they are written. Returns false if the
+// file could not be mapped or is not a valid map file, which includes a cell type or action out of range.
+bool MapLoad(Map *map, const char *path, bool shared)
+{
+	int file = open(path, shared ? O_RDWR : O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < (off_t)sizeof(MapFileHeader))
+	{
+		close(file);
+		return false;
+	}
+
+	// The mapping stays valid after the file is closed
+	size_t size = (size_t)status.st_size;
+	void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	const MapFileHeader *header = mapping;
+	if (!MapFileHeaderValid(header, size))
+	{
+		munmap(mapping, size);
+		return false;
+	}
+
+	MapDefaults(map);
+	MapAttach(map, header->width, header->height, (uint8_t*)mapping + header->headerSize);
+	map->mapping = mapping;
+	map->mappingSize = size;
+	map->mappingShared = shared;
+	map->theta = header->theta;
+	map->probability = header->probability;
+	map->gamma = header->gamma;
+	map->max_iterations = header->maxIterations;
+	map->movementPenalty = header->movementPenalty;
+	map->collisionPenalty = header->collisionPenalty;
+	if (!MapPlanesValid(map))
+	{
+		MapFree(map);
+		return false;
+	}
+
+	// The transition masks are derived from the cell types, so a file written by another tool only needs those right
+	TransitionTableInit(map);
+	map->solved = (header->flags & MAP_FILE_SOLVED) != 0;
+
+	return true;
+}
+
+// Writes the parameters and solved state of a mapped map to its header and flushes the mapping to the file, which only
+// reaches the file if the map was loaded with shared set. Returns false if the map is not mapped or the flush failed.
+bool MapSync(Map *map)
+{
+	if (map->mapping == NULL)
+	{
+		return false;
+	}
+
+	// A file written by another tool may have a longer header, it is kept
+	MapFileHeader *header = map->mapping;
+	MapFileHeaderFill(header, map, header->headerSize);
+
+	return msync(map->mapping, map->mappingSize, MS_SYNC) == 0;
+}
@@ -0,0 +1,56 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdint.h>
+#include "valuefunction.h"
+
+// Version written to new files, bumped whenever the layout changes
+#define MAP_FILE_VERSION 1
+// Bytes before the first plane, one page so the planes of a mapped file start page aligned
+#define MAP_FILE_HEADER_SIZE 4096
+// Written in the native byte order, a file from a machine of the other byte order reads back differently
+#define MAP_FILE_BYTE_ORDER 0x01020304u
+// Header flag set when the values and actions are a solution of the grid
+#define MAP_FILE_SOLVED 1u
+
+// Start of a map file, followed by padding up to headerSize and then the map's plane block exactly as MapAttach lays
+// it out. Every plane has the grid's ghost border and rows of stride cells, offsets are from the start of the file.
+typedef struct MapFileHeader
+{
+	char magic[8]; // "VALUEMAP"
+	uint32_t version; // MAP_FILE_VERSION
+	uint32_t headerSize; // Bytes before the first plane
+	uint32_t byteOrder; // MAP_FILE_BYTE_ORDER
+	uint32_t flags; // MAP_FILE_SOLVED
+	int32_t width; // Number of columns
+	int32_t height; // Number of rows
+	int32_t stride; // Cells in a plane row, width + 2
+	float theta;
+	float probability;
+	float gamma;
+	int32_t maxIterations;
+	int32_t movementPenalty;
+	int32_t collisionPenalty;
+	uint64_t valueOffset; // float per cell
+	uint64_t gapOffset; // float per cell
+	uint64_t cellTypeOffset; // CellType per cell, one byte
+	uint64_t actionOffset; // Direction per cell, one byte, 8 for none
+	uint64_t blockedOffset; // Transition masks per cell, one byte, rebuilt from the cell types on load
+	uint64_t collideOffset;
+	uint64_t fileSize; // Header and planes
+} MapFileHeader;
+
+// Writes the grid, parameters, values and actions of a map to a new file, the plane block is written as it is held
+// in memory. Returns false if the file could not be written. A map loaded from the same file is kept up to date by
+// MapSync instead.
+bool MapSave(const Map*, const char*);
+// Maps a map file into memory and points the map's planes straight into it, nothing is copied. The cells are checked
+// and the ghost border is made obstructions. With shared set, solving the map writes its values and actions through to
+// the file, otherwise the file is left unchanged and pages are copied only as they are written. Returns false if the
+// file could not be mapped or is not a valid map file, which includes a cell type or action out of range.
+bool MapLoad(Map*, const char*, bool);
+// Writes the parameters and solved state of a mapped map to its header and flushes the mapping to the file, which only
+// reaches the file if the map was loaded with shared set. Returns false if the map is not mapped or the flush failed.
+bool MapSync(Map*);
+
+#endif
@@ -0,0 +1,155 @@
+#include "valuefunction.h"
+
+// Grids narrower or shorter than twice this are solved directly instead of coarsened further
+#define MULTIGRID_MIN_SIZE 16
+
+// Builds the grid with one cell for each 2 x 2 block of the fine grid, returns false if it could not be allocated
+// A block holding a goal or a hole becomes one, so no terminal value is lost, and otherwise is open if any of it is
+// open, so the paths through it are kept. Only blocks of obstructions become obstructions.
+static bool Coarsen(const Map *fine, Map *coarse)
+{
+	if (!MapAlloc(coarse, (fine->width + 1) / 2, (fine->height + 1) / 2))
+	{
+		return false;
+	}
+
+	// Settings the coarse grid does not take from the fine one keep their defaults
+	MapDefaults(coarse);
+	coarse->theta = fine->theta;
+	coarse->probability = fine->probability;
+	// A coarse move takes two fine moves, so it is discounted twice
+	coarse->gamma = fine->gamma * fine->gamma;
+	// A quarter of the cells, so twice the sweeps still cost half as much
+	coarse->max_iterations = 2 * fine->max_iterations;
+	// A coarse move crosses two fine cells
+	coarse->movementPenalty = 2 * fine->movementPenalty;
+	coarse->collisionPenalty = 2 * fine->collisionPenalty;
+	coarse->solver = MULTIGRID;
+	// Only the values of the coarse grids are used
+	coarse->fusedPolicy = false;
+	coarse->threads = fine->threads;
+	coarse->evaluationSweeps = fine->evaluationSweeps;
+	// The coarse values are only a starting point, so the coarse solves stop on the change in value whatever the fine
+	// grid's stop rule, which its own sweeps apply
+	coarse->stopRule = STOP_ON_DELTA;
+	GridClear(coarse);
+
+	for (int y = 0; y < coarse->height; y++)
+	{
+		for (int x = 0; x < coarse->width; x++)
+		{
+			bool goal = false;
+			bool hole = false;
+			int open = 0;
+			float goal_v = 0;
+			float hole_v = 0;
+			float open_v = 0;
+
+			for (int fine_y = 2 * y; fine_y < 2 * y + 2; fine_y++)
+			{
+				for (int fine_x = 2 * x; fine_x < 2 * x + 2; fine_x++)
+				{
+					if (!IndexIsValid(fine, fine_x, fine_y))
+					{
+						continue;
+					}
+					size_t i = MapIndex(fine, fine_x, fine_y);
+					float v = fine->value[i];
+					switch (fine->cellType[i])
+					{
+						case GOAL: goal_v = goal && goal_v > v ? goal_v : v; goal = true; break;
+						case HOLE: hole_v = hole && hole_v < v ? hole_v : v; hole = true; break;
+						case OPEN: open_v += v; open++; break;
+						default: break;
+					}
+				}
+			}
+
+			size_t i = MapIndex(coarse, x, y);
+			if (goal)
+			{
+				coarse->cellType[i] = GOAL;
+				coarse->value[i] = goal_v;
+			}
+			else if (hole)
+			{
+				coarse->cellType[i] = HOLE;
+				coarse->value[i] = hole_v;
+			}
+			else if (open > 0)
+			{
+				coarse->cellType[i] = OPEN;
+				coarse->value[i] = open_v / open;
+			}
+		}
+	}
+
+	TransitionTableInit(coarse);
+
+	return true;
+}
+
+// Starts each open fine cell from the value of the coarse cell covering it
+// An open cell in a goal or hole block takes the mean of the open coarse cells around the block instead
+static void Interpolate(const Map *coarse, Map *fine)
+{
+	for (int y = 0; y < fine->height; y++)
+	{
+		for (int x = 0; x < fine->width; x++)
+		{
+			size_t i = MapIndex(fine, x, y);
+			if (fine->cellType[i] != OPEN)
+			{
+				continue;
+			}
+
+			size_t c = MapIndex(coarse, x / 2, y / 2);
+			if (coarse->cellType[c] == OPEN)
+			{
+				fine->value[i] = coarse->value[c];
+				continue;
+			}
+
+			int open = 0;
+			float open_v = 0;
+			for (int new_y = y / 2 - 1; new_y <= y / 2 + 1; new_y++)
+			{
+				for (int new_x = x / 2 - 1; new_x <= x / 2 + 1; new_x++)
+				{
+					if (IndexIsValid(coarse, new_x, new_y) && coarse->cellType[MapIndex(coarse, new_x, new_y)] == OPEN)
+					{
+						open_v += coarse->value[MapIndex(coarse, new_x, new_y)];
+						open++;
+					}
+				}
+			}
+			if (open > 0)
+			{
+				fine->value[i] = open_v / open;
+			}
+		}
+	}
+}
+
+// Solves a grid coarsened to half the size in each direction, recursively, and sweeps from its interpolated values
+// iterations counts the sweeps of this grid only, backups the backups of every level
+void Multigrid(Map *map)
+{
+	long long coarseBackups = 0;
+
+	if (map->width >= 2 * MULTIGRID_MIN_SIZE && map->height >= 2 * MULTIGRID_MIN_SIZE)
+	{
+		// Without the coarse grid the sweeps start from the current values
+		Map coarse;
+		if (Coarsen(map, &coarse))
+		{
+			Multigrid(&coarse);
+			Interpolate(&coarse, map);
+			coarseBackups = coarse.backups;
+		}
+		MapFree(&coarse);
+	}
+
+	ComputeValueFunction(map);
+	map->backups += coarseBackups;
+}
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "threadpool.h"
+#include "telemetry.h"
+
+// Largest change found by one thread, padded to a cache line so threads do not share one
+typedef struct BandDelta
+{
+	_Alignas(MAP_ALIGNMENT) float delta;
+} BandDelta;
+
+// Shared state of one Jacobi sweep
+typedef struct JacobiSweep
+{
+	const Map *map;
+	const Transitions *transitions;
+	const float *src; // Values of the previous sweep
+	float *dst; // Values of this sweep
+	BandDelta *deltas; // One per thread
+} JacobiSweep;
+
+// Shared state of one colour of a red-black sweep
+typedef struct RedBlackSweep
+{
+	const Map *map;
+	const Transitions *transitions;
+	int colour; // 0 updates the even rows, 1 the odd rows
+	BandDelta *deltas; // One per thread
+} RedBlackSweep;
+
+// Backs up the band of rows belonging to one thread
+static void JacobiBand(void *context, int thread, int threads)
+{
+	JacobiSweep *sweep = context;
+	const Map *map = sweep->map;
+	int begin = (int)((long long)map->height * thread / threads);
+	int end = (int)((long long)map->height * (thread + 1) / threads);
+	float delta = 0;
+
+	for (int y = begin; y < end; y++)
+	{
+		float row_delta = BackupRow(sweep->transitions, map, sweep->src, sweep->dst, map->fusedPolicy, y, 0, map->width);
+		if (row_delta > delta)
+		{
+			delta = row_delta;
+		}
+	}
+
+	sweep->deltas[thread].delta = delta;
+}
+
+// Loops through grid on several threads, reading the previous sweep's values from one plane and writing the next
+void ComputeValueFunctionJacobi(Map *map)
+{
+	int threads = ThreadCount(map->threads);
+	threads = threads < map->height ? threads : map->height;
+	size_t planeSize = (MapPlaneLength(map) * sizeof(float) + MAP_ALIGNMENT - 1) / MAP_ALIGNMENT * MAP_ALIGNMENT;
+	float *scratch = aligned_alloc(MAP_ALIGNMENT, planeSize);
+	BandDelta *deltas = aligned_alloc(MAP_ALIGNMENT, threads * sizeof(BandDelta));
+	ThreadPool pool;
+
+	// Without the second plane or the threads fall back to the in-place sweep
+	if (scratch == NULL || deltas == NULL || !ThreadPoolInit(&pool, threads))
+	{
+		free(scratch);
+		free(deltas);
+		ComputeValueFunction(map);
+		return;
+	}
+
+	Transitions transitions;
+	TransitionsInit(&transitions, map);
+	TelemetryStart(map, map->fusedPolicy);
+
+	// Both planes start with the current values so cells that are never backed up agree
+	memcpy(scratch, map->value, MapPlaneLength(map) * sizeof(float));
+
+	JacobiSweep sweep =
+	{
+		.map = map,
+		.transitions = &transitions,
+		.src = map->value,
+		.dst = scratch,
+		.deltas = deltas
+	};
+	bool loop = true;
+	int iterations = 0;
+	long long open = CountOpenCells(map);
+
+	while (loop == true)
+	{
+		ThreadPoolRun(&pool, JacobiBand, &sweep);
+
+		// Combine the largest change of each band
+		float delta = 0;
+		for (int thread = 0; thread < threads; thread++)
+		{
+			if (deltas[thread].delta > delta)
+			{
+				delta = deltas[thread].delta;
+			}
+		}
+
+		// The values just written are read by the next sweep
+		float *swap = (float*)sweep.src;
+		sweep.src = sweep.dst;
+		sweep.dst = swap;
+
+		iterations += 1;
+		map->iterations = iterations;
+		map->backups = iterations * open;
+
+		// Terminate the loop on convergence, when the maximum number of iterations is met or when the sweep callback
+		// asks to stop. The callback sees map->value, which holds either this sweep's values or the previous sweep's.
+		bool more = SweepDone(map, delta);
+		map->stopReason = SweepStopReason(map, iterations, delta, more);
+		if (map->stopReason != STOP_NONE)
+		{
+			loop = false;
+		}
+	}
+
+	// The latest values are in src, copy them back if that is the scratch plane
+	if (sweep.src != map->value)
+	{
+		memcpy(map->value, sweep.src, MapPlaneLength(map) * sizeof(float));
+	}
+
+	ThreadPoolFree(&pool);
+	free(scratch);
+	free(deltas);
+}
+
+// Backs up in place the rows of the current colour belonging to one thread
+// Rows of one colour are two apart, so no cell of one can be reached by a move from another and the threads
+// never read a value another thread is writing
+static void RedBlackBand(void *context, int thread, int threads)
+{
+	RedBlackSweep *sweep = context;
+	const Map *map = sweep->map;
+	int rows = (map->height - sweep->colour + 1) / 2;
+	int begin = (int)((long long)rows * thread / threads);
+	int end = (int)((long long)rows * (thread + 1) / threads);
+	float delta = sweep->deltas[thread].delta;
+
+	for (int row = begin; row < end; row++)
+	{
+		int y = 2 * row + sweep->colour;
+		float row_delta = BackupRow(sweep->transitions, map, map->value, map->value, map->fusedPolicy, y, 0, map->width);
+		if (row_delta > delta)
+		{
+			delta = row_delta;
+		}
+	}
+
+	sweep->deltas[thread].delta = delta;
+}
+
+// Loops through grid in place on several threads, updating all even rows and then all odd rows
+void ComputeValueFunctionRedBlack(Map *map)
+{
+	int threads = ThreadCount(map->threads);
+	int rows = (map->height + 1) / 2;
+	threads = threads < rows ? threads : rows;
+	BandDelta *deltas = aligned_alloc(MAP_ALIGNMENT, threads * sizeof(BandDelta));
+	ThreadPool pool;
+
+	// Without the threads fall back to the in-place sweep
+	if (deltas == NULL || !ThreadPoolInit(&pool, threads))
+	{
+		free(deltas);
+		ComputeValueFunction(map);
+		return;
+	}
+
+	Transitions transitions;
+	TransitionsInit(&transitions, map);
+	TelemetryStart(map, map->fusedPolicy);
+
+	RedBlackSweep sweep =
+	{
+		.map = map,
+		.transitions = &transitions,
+		.deltas = deltas
+	};
+	bool loop = true;
+	int iterations = 0;
+	long long open = CountOpenCells(map);
+
+	while (loop == true)
+	{
+		for (int thread = 0; thread < threads; thread++)
+		{
+			deltas[thread].delta = 0;
+		}
+
+		// The odd rows read the even rows' new values, as in a sequential in-place sweep
+		for (sweep.colour = 0; sweep.colour < 2; sweep.colour++)
+		{
+			ThreadPoolRun(&pool, RedBlackBand, &sweep);
+		}
+
+		// Combine the largest change of each band
+		float delta = 0;
+		for (int thread = 0; thread < threads; thread++)
+		{
+			if (deltas[thread].delta > delta)
+			{
+				delta = deltas[thread].delta;
+			}
+		}
+
+		iterations += 1;
+		map->iterations = iterations;
+		map->backups = iterations * open;
+
+		// Terminate the loop on convergence, when the maximum number of iterations is met or when the sweep callback
+		// asks to stop
+		bool more = SweepDone(map, delta);
+		map->stopReason = SweepStopReason(map, iterations, delta, more);
+		if (map->stopReason != STOP_NONE)
+		{
+			loop = false;
+		}
+	}
+
+	ThreadPoolFree(&pool);
+	free(deltas);
+}
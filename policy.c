@@ -0,0 +1,146 @@
+#include <math.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "telemetry.h"
+
+// Sweeps the grid in place with every open cell following its current action, returns the largest change
+static float EvaluationSweep(const Transitions *t, Map *map)
+{
+	float delta = 0;
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == OPEN)
+			{
+				float old_v = map->value[i];
+				map->value[i] = EvaluateCell(t, map, map->value, i, map->action[i]);
+				delta = fmaxf(delta, fabsf(old_v - map->value[i]));
+			}
+		}
+	}
+	return delta;
+}
+
+// Makes every open cell's action greedy for the current values, backing up the values at the same time
+// A cell keeps its action unless another is strictly better, so ties cannot make the policy cycle
+// Returns the number of actions changed and stores the largest Bellman residual
+static long long ImprovementSweep(const Transitions *t, Map *map, float *residual)
+{
+	long long changes = 0;
+	*residual = 0;
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == OPEN)
+			{
+				int best_action;
+				float old_v = map->value[i];
+				float max_v = BackupCell(t, map, map->value, i, &best_action, &map->gap[i]);
+
+				// Cells without an action yet take the best one
+				if (map->action[i] > 7 || max_v > EvaluateCell(t, map, map->value, i, map->action[i]))
+				{
+					changes += map->action[i] != best_action;
+					map->action[i] = best_action;
+				}
+
+				map->value[i] = max_v;
+				*residual = fmaxf(*residual, fabsf(old_v - max_v));
+			}
+		}
+	}
+	TelemetryPolicyChanged(map, changes);
+	return changes;
+}
+
+// Alternates improving the policy with evaluating it for the given number of sweeps, or until the values change
+// by less than theta if sweeps is 0
+static void IteratePolicy(Map *map, int sweeps)
+{
+	Transitions transitions;
+	long long open = CountOpenCells(map);
+
+	// Set when the last evaluation of the policy got below theta
+	bool evaluated = false;
+	// Cleared when the sweep callback asks to stop
+	bool loop = true;
+
+	TransitionsInit(&transitions, map);
+	map->iterations = 0;
+	map->improvements = 0;
+	map->backups = 0;
+	map->stopReason = STOP_NONE;
+	TelemetryStart(map, true);
+
+	while (loop && map->improvements <= map->max_iterations)
+	{
+		// Greedy improvement, which is also one sweep of value iteration
+		float residual;
+		long long changes = ImprovementSweep(&transitions, map, &residual);
+		map->improvements++;
+		map->iterations++;
+		map->backups += open;
+
+		// Stop when the sweep callback asks to, or when the policy is stable and its values have converged
+		if (!SweepDone(map, residual))
+		{
+			map->stopReason = STOP_CALLBACK;
+			break;
+		}
+		if (changes == 0 && (evaluated || residual < map->theta))
+		{
+			map->stopReason = STOP_CONVERGED;
+			break;
+		}
+
+		// Evaluate the new policy
+		// A largest change that stops shrinking means some cell's action never reaches a terminal cell and its value
+		// would fall without end, so improve the policy again instead
+		evaluated = false;
+		float last_delta = INFINITY;
+		for (int sweep = 0; sweeps == 0 ? sweep <= map->max_iterations : sweep < sweeps; sweep++)
+		{
+			float delta = EvaluationSweep(&transitions, map);
+			map->iterations++;
+			map->backups += open;
+			if (!SweepDone(map, delta))
+			{
+				map->stopReason = STOP_CALLBACK;
+				loop = false;
+				break;
+			}
+			if (delta < map->theta)
+			{
+				evaluated = true;
+				break;
+			}
+			if (delta >= last_delta)
+			{
+				break;
+			}
+			last_delta = delta;
+		}
+	}
+
+	// Otherwise the improvement steps ran out
+	if (map->stopReason == STOP_NONE)
+	{
+		map->stopReason = STOP_MAX_ITERATIONS;
+	}
+}
+
+// Alternates evaluating the current policy until the values change by less than theta with improving it greedily
+void PolicyIteration(Map *map)
+{
+	IteratePolicy(map, 0);
+}
+
+// Alternates evaluationSweeps sweeps of policy evaluation with improving the policy greedily
+void ModifiedPolicyIteration(Map *map)
+{
+	IteratePolicy(map, map->evaluationSweeps > 0 ? map->evaluationSweeps : 1);
+}
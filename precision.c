@@ -0,0 +1,278 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "telemetry.h"
+
+// Rows backed up between slides of the float window, which also holds the rows either side of them
+#define WINDOW_ROWS 64
+
+// Reduced sweeps in a row that may fail to lower the largest change before the float sweeps take over, rounding can
+// leave a few cells cycling between neighbouring values
+#define STALL_SWEEPS 8
+
+// Relative rounding step of a bf16, which keeps 8 significant bits. A change smaller than this fraction of the
+// largest value may be rounded away, so the reduced sweeps cannot converge any further.
+#define BF16_STEP (1.0f / 256)
+
+// Bits of a float, which for a value that is not negative order the same way as the value
+static inline uint32_t FloatBits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+// Rounds a float down to a bf16, which is the top half of its bits
+static inline uint16_t FloatToBf16(float value)
+{
+	uint32_t bits = FloatBits(value);
+	bits += bits >> 31 ? 0xffff : 0;
+	return (uint16_t)(bits >> 16);
+}
+
+// Widens a bf16 back to a float exactly
+static inline float Bf16ToFloat(uint16_t half)
+{
+	uint32_t bits = (uint32_t)half << 16;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// The conversions run once per cell on every sweep, as often as the backups, so they are vectorized for the same
+// instruction sets as the row kernel and finish each row with the scalar ones
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define CONVERT_WIDTH 16
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define CONVERT_WIDTH 8
+#else
+#define CONVERT_WIDTH 1
+#endif
+
+// Widens plane row row of the bf16 plane into a row of floats
+static void RowWiden(const Map *map, const uint16_t *plane, int row, float *dst)
+{
+	const uint16_t *src = plane + (size_t)row * map->stride;
+	int x = 0;
+#if defined(__AVX512F__)
+	for (; x + CONVERT_WIDTH <= map->stride; x += CONVERT_WIDTH)
+	{
+		__m512i half = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(src + x)));
+		_mm512_storeu_ps(dst + x, _mm512_castsi512_ps(_mm512_slli_epi32(half, 16)));
+	}
+#elif defined(__AVX2__)
+	for (; x + CONVERT_WIDTH <= map->stride; x += CONVERT_WIDTH)
+	{
+		__m256i half = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + x)));
+		_mm256_storeu_ps(dst + x, _mm256_castsi256_ps(_mm256_slli_epi32(half, 16)));
+	}
+#endif
+	for (; x < map->stride; x++)
+	{
+		dst[x] = Bf16ToFloat(src[x]);
+	}
+}
+
+// Rounds a row of floats into plane row row of the bf16 plane, returns the largest change in the stored values and
+// stores the largest magnitude in the row in largest
+static float RowNarrow(const Map *map, const float *src, uint16_t *plane, int row, float *largest)
+{
+	uint16_t *dst = plane + (size_t)row * map->stride;
+	// Maxima of the bits of magnitudes, which order the same way as the magnitudes and need no float compares
+	uint32_t delta = 0;
+	uint32_t magnitude = 0;
+	int x = 0;
+#if defined(__AVX512F__)
+	__m512i sign = _mm512_set1_epi32(0x7fffffff);
+	__m512i delta_v = _mm512_setzero_si512();
+	__m512i magnitude_v = _mm512_setzero_si512();
+	for (; x + CONVERT_WIDTH <= map->stride; x += CONVERT_WIDTH)
+	{
+		// Rounds down as FloatToBf16 does, a negative value is moved away from zero first
+		__m512i bits = _mm512_castps_si512(_mm512_loadu_ps(src + x));
+		__m512i half = _mm512_srli_epi32(_mm512_add_epi32(bits, _mm512_srli_epi32(_mm512_srai_epi32(bits, 31), 16)), 16);
+		__m512i old = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(dst + x)));
+		__m512 change = _mm512_sub_ps(_mm512_castsi512_ps(_mm512_slli_epi32(half, 16)),
+			_mm512_castsi512_ps(_mm512_slli_epi32(old, 16)));
+		delta_v = _mm512_max_epu32(delta_v, _mm512_and_si512(_mm512_castps_si512(change), sign));
+		magnitude_v = _mm512_max_epu32(magnitude_v, _mm512_and_si512(bits, sign));
+		_mm256_storeu_si256((__m256i*)(dst + x), _mm512_cvtepi32_epi16(half));
+	}
+	delta = _mm512_reduce_max_epu32(delta_v);
+	magnitude = _mm512_reduce_max_epu32(magnitude_v);
+#elif defined(__AVX2__)
+	__m256i sign = _mm256_set1_epi32(0x7fffffff);
+	__m256i delta_v = _mm256_setzero_si256();
+	__m256i magnitude_v = _mm256_setzero_si256();
+	for (; x + CONVERT_WIDTH <= map->stride; x += CONVERT_WIDTH)
+	{
+		// Rounds down as FloatToBf16 does, a negative value is moved away from zero first
+		__m256i bits = _mm256_castps_si256(_mm256_loadu_ps(src + x));
+		__m256i half = _mm256_srli_epi32(_mm256_add_epi32(bits, _mm256_srli_epi32(_mm256_srai_epi32(bits, 31), 16)), 16);
+		__m256i old = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(dst + x)));
+		__m256 change = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_slli_epi32(half, 16)),
+			_mm256_castsi256_ps(_mm256_slli_epi32(old, 16)));
+		delta_v = _mm256_max_epu32(delta_v, _mm256_and_si256(_mm256_castps_si256(change), sign));
+		magnitude_v = _mm256_max_epu32(magnitude_v, _mm256_and_si256(bits, sign));
+		// Packing works within 128 bit halves, so the two halves of the result are gathered into the low one
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(half, half), 0x08);
+		_mm_storeu_si128((__m128i*)(dst + x), _mm256_castsi256_si128(packed));
+	}
+	uint32_t lanes[CONVERT_WIDTH];
+	_mm256_storeu_si256((__m256i*)lanes, delta_v);
+	for (int k = 0; k < CONVERT_WIDTH; k++)
+	{
+		delta = lanes[k] > delta ? lanes[k] : delta;
+	}
+	_mm256_storeu_si256((__m256i*)lanes, magnitude_v);
+	for (int k = 0; k < CONVERT_WIDTH; k++)
+	{
+		magnitude = lanes[k] > magnitude ? lanes[k] : magnitude;
+	}
+#endif
+	for (; x < map->stride; x++)
+	{
+		uint16_t half = FloatToBf16(src[x]);
+		uint32_t change = FloatBits(Bf16ToFloat(half) - Bf16ToFloat(dst[x])) & 0x7fffffff;
+		uint32_t size = FloatBits(src[x]) & 0x7fffffff;
+		delta = change > delta ? change : delta;
+		magnitude = size > magnitude ? size : magnitude;
+		dst[x] = half;
+	}
+	memcpy(largest, &magnitude, sizeof(float));
+	float result;
+	memcpy(&result, &delta, sizeof(float));
+	return result;
+}
+
+// Sweeps with the values stored as bf16, half the bytes of a float, until the changes are too small for bf16 to
+// resolve, then finishes with ComputeValueFunction on the float plane. Each row is widened into a window of floats,
+// backed up by the row kernel and rounded back, so the arithmetic is the same as ComputeValueFunction's and only the
+// storage between backups is rounded. The solve stops where ComputeValueFunction would, as only the float sweeps test
+// against theta. Falls back to ComputeValueFunction if the bf16 plane could not be allocated.
+void ComputeValueFunctionReduced(Map *map)
+{
+	size_t cells = MapPlaneLength(map);
+	size_t windowSize = ((size_t)(WINDOW_ROWS + 2) * map->stride * sizeof(float) + MAP_ALIGNMENT - 1) / MAP_ALIGNMENT *
+		MAP_ALIGNMENT;
+	uint16_t *plane = malloc(cells * sizeof(uint16_t));
+	float *window = aligned_alloc(MAP_ALIGNMENT, windowSize);
+	if (plane == NULL || window == NULL)
+	{
+		free(plane);
+		free(window);
+		ComputeValueFunction(map);
+		return;
+	}
+
+	for (size_t i = 0; i < cells; i++)
+	{
+		plane[i] = FloatToBf16(map->value[i]);
+	}
+
+	bool loop = true;
+	bool stopped = false;
+	int iterations = 0;
+	float best = INFINITY;
+	int stalled = 0;
+	long long open = CountOpenCells(map);
+	Transitions transitions;
+
+	TransitionsInit(&transitions, map);
+	TelemetryStart(map, false);
+
+	while (loop == true)
+	{
+		float delta = 0;
+		float largest = 0;
+
+		// The window holds plane rows top to top + WINDOW_ROWS + 1, starting with the top ghost row
+		int top = 0;
+		for (int row = 0; row < WINDOW_ROWS + 2 && row < map->height + 2; row++)
+		{
+			RowWiden(map, plane, row, window + (size_t)row * map->stride);
+		}
+
+		for (int y = 0; y < map->height; y++)
+		{
+			// Once the window runs out of rows below, its last two rows move to the top and the next rows are read in
+			if (y + 2 > top + WINDOW_ROWS + 1)
+			{
+				memmove(window, window + (size_t)WINDOW_ROWS * map->stride, 2 * (size_t)map->stride * sizeof(float));
+				top += WINDOW_ROWS;
+				for (int row = top + 2; row < top + WINDOW_ROWS + 2 && row < map->height + 2; row++)
+				{
+					RowWiden(map, plane, row, window + (size_t)(row - top) * map->stride);
+				}
+			}
+
+			// The kernel indexes src by plane index, so the window is addressed as if it were those rows of a whole
+			// plane
+			float *src = window - (size_t)top * map->stride;
+			BackupRow(&transitions, map, src, src, false, y, 0, map->width);
+
+			// The change is measured in the stored values, a change that rounds away has not been made
+			float row_largest;
+			float row_delta = RowNarrow(map, src + (size_t)(y + 1) * map->stride, plane, y + 1, &row_largest);
+			delta = row_delta > delta ? row_delta : delta;
+			largest = row_largest > largest ? row_largest : largest;
+		}
+
+		iterations += 1;
+		map->iterations = iterations;
+		map->backups = iterations * open;
+
+		// Switch to floats once bf16 cannot resolve the changes any more, the reduced sweeps have converged or they
+		// have stopped making progress
+		stalled = delta < best ? 0 : stalled + 1;
+		best = delta < best ? delta : best;
+		if (delta < map->theta || delta < largest * BF16_STEP || stalled >= STALL_SWEEPS)
+		{
+			loop = false;
+		}
+
+		// The float sweeps make at least one more sweep, so the reduced ones stop one short of the limit
+		if (iterations >= map->max_iterations)
+		{
+			loop = false;
+		}
+
+		// Terminate the whole solve if the sweep callback asks to stop
+		if (!SweepDone(map, delta))
+		{
+			loop = false;
+			stopped = true;
+		}
+	}
+
+	for (size_t i = 0; i < cells; i++)
+	{
+		map->value[i] = Bf16ToFloat(plane[i]);
+	}
+	free(plane);
+	free(window);
+
+	// The reduced sweeps never record the policy, so a stopped solve reads it off the values it got to
+	if (stopped)
+	{
+		map->stopReason = STOP_CALLBACK;
+		if (map->fusedPolicy)
+		{
+			ExtractPolicy(map);
+		}
+		return;
+	}
+
+	// The float sweeps get what is left of the iteration limit and their counts follow on from the reduced ones
+	int max_iterations = map->max_iterations;
+	map->max_iterations -= iterations;
+	TelemetryContinue(map);
+	ComputeValueFunction(map);
+	map->max_iterations = max_iterations;
+	map->iterations += iterations;
+	map->backups += iterations * open;
+}
@@ -0,0 +1,260 @@
+#include <math.h>
+#include <stdlib.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "telemetry.h"
+
+// Marks a cell that is not in the queue
+#define NOT_QUEUED SIZE_MAX
+
+// Cell waiting in the queue, with the priority it is keyed on kept next to it so the sifts read one array
+typedef struct QueueEntry
+{
+	float priority;
+	size_t index;
+} QueueEntry;
+
+// Binary max-heap of open cells keyed on an estimate of their Bellman residual, each cell at most once. The heap
+// position of every cell is kept, so a cell whose estimate rises is moved up rather than queued again.
+typedef struct Queue
+{
+	QueueEntry *entries;
+	size_t count;
+	size_t *position; // Heap position of each cell, NOT_QUEUED when it is not queued
+} Queue;
+
+// Puts an entry at a heap position
+static inline void QueuePlace(Queue *queue, size_t slot, QueueEntry entry)
+{
+	queue->entries[slot] = entry;
+	queue->position[entry.index] = slot;
+}
+
+// Moves the entry at a heap position up past the parents with a lower priority
+static void QueueSiftUp(Queue *queue, size_t slot)
+{
+	QueueEntry entry = queue->entries[slot];
+	while (slot > 0 && queue->entries[(slot - 1) / 2].priority < entry.priority)
+	{
+		QueuePlace(queue, slot, queue->entries[(slot - 1) / 2]);
+		slot = (slot - 1) / 2;
+	}
+	QueuePlace(queue, slot, entry);
+}
+
+// Moves the entry at a heap position down past the children with a higher priority
+static void QueueSiftDown(Queue *queue, size_t slot)
+{
+	QueueEntry entry = queue->entries[slot];
+	while (2 * slot + 1 < queue->count)
+	{
+		size_t child = 2 * slot + 1;
+		if (child + 1 < queue->count && queue->entries[child + 1].priority > queue->entries[child].priority)
+		{
+			child++;
+		}
+		if (queue->entries[child].priority <= entry.priority)
+		{
+			break;
+		}
+		QueuePlace(queue, slot, queue->entries[child]);
+		slot = child;
+	}
+	QueuePlace(queue, slot, entry);
+}
+
+// Removes the cell with the highest priority from the heap, the last entry fills its place
+static size_t QueuePop(Queue *queue)
+{
+	size_t top = queue->entries[0].index;
+	queue->position[top] = NOT_QUEUED;
+	if (--queue->count > 0)
+	{
+		QueuePlace(queue, 0, queue->entries[queue->count]);
+		QueueSiftDown(queue, 0);
+	}
+	return top;
+}
+
+// Raises a cell's priority to an estimate of its residual, queuing it if the estimate is above theta. A cell already
+// queued with a higher priority keeps it.
+static void QueueRaise(Queue *queue, const Map *map, size_t i, float priority)
+{
+	size_t slot = queue->position[i];
+	if (priority <= map->theta || (slot != NOT_QUEUED && priority <= queue->entries[slot].priority))
+	{
+		return;
+	}
+
+	if (slot == NOT_QUEUED)
+	{
+		slot = queue->count++;
+	}
+	QueuePlace(queue, slot, (QueueEntry){ .priority = priority, .index = i });
+	QueueSiftUp(queue, slot);
+}
+
+// Computes the Bellman residual of an open cell and queues it if it is large enough
+static void QueueCell(Map *map, const Transitions *transitions, Queue *queue, size_t i)
+{
+	int best_action;
+	float residual = fabsf(BackupCell(transitions, map, map->value, i, &best_action, NULL) - map->value[i]);
+	map->backups++;
+	QueueRaise(queue, map, i, residual);
+}
+
+// Backs up queued cells, largest residual first, starting from every open cell if seeds is NULL or else from the
+// cells next to each seed. With policy set each backup also records the best action and action gap.
+// Returns false if the queue could not be allocated.
+static bool Prioritize(Map *map, const size_t *seeds, size_t count, bool policy)
+{
+	Transitions transitions;
+	long long open = CountOpenCells(map);
+	// Stop after as many backups as max_iterations full sweeps would make
+	long long budget = ((long long)map->max_iterations + 1) * open;
+	// The sweep callback is called after each sweep's worth of backups, with the largest change since the last call
+	long long report = open;
+	float delta = 0;
+	// Cleared when the sweep callback asks to stop
+	bool more = true;
+
+	// Each open cell is queued at most once, so the heap never grows
+	size_t cells = MapPlaneLength(map);
+	Queue queue = { .count = 0 };
+	queue.entries = malloc((open > 0 ? open : 1) * sizeof(QueueEntry));
+	queue.position = malloc(cells * sizeof(size_t));
+	if (queue.entries == NULL || queue.position == NULL)
+	{
+		free(queue.entries);
+		free(queue.position);
+		return false;
+	}
+	for (size_t i = 0; i < cells; i++)
+	{
+		queue.position[i] = NOT_QUEUED;
+	}
+
+	TransitionsInit(&transitions, map);
+	map->backups = 0;
+	TelemetryStart(map, policy);
+
+	// Largest chance of one move reaching a given neighbour, discounted
+	float reach = transitions.gamma * fmaxf(transitions.probability[1], fmaxf(transitions.probability[0],
+		transitions.probability[2]));
+
+	if (seeds == NULL)
+	{
+		// Every open cell whose value is out of date starts in the queue
+		for (int y = 0; y < map->height; y++)
+		{
+			for (int x = 0; x < map->width; x++)
+			{
+				size_t i = MapIndex(map, x, y);
+				if (map->cellType[i] == OPEN)
+				{
+					QueueCell(map, &transitions, &queue, i);
+				}
+			}
+		}
+	}
+	else
+	{
+		// Only the seeds and their neighbours, whose moves may have changed, start in the queue
+		for (size_t k = 0; k < count; k++)
+		{
+			if (map->cellType[seeds[k]] == OPEN)
+			{
+				QueueCell(map, &transitions, &queue, seeds[k]);
+			}
+			for (int d = 0; d < 8; d++)
+			{
+				size_t neighbour = seeds[k] + transitions.offset[d];
+				if (map->cellType[neighbour] == OPEN)
+				{
+					QueueCell(map, &transitions, &queue, neighbour);
+				}
+			}
+		}
+	}
+
+	while (queue.count > 0 && map->backups < budget)
+	{
+		if (map->backups >= report)
+		{
+			map->iterations = (int)(map->backups / open);
+			more = SweepDone(map, delta);
+			if (!more)
+			{
+				break;
+			}
+			report = map->backups + open;
+			delta = 0;
+		}
+
+		size_t i = QueuePop(&queue);
+
+		int best_action;
+		float gap;
+		float old_v = map->value[i];
+		map->value[i] = BackupCell(&transitions, map, map->value, i, &best_action, &gap);
+		map->backups++;
+		if (policy)
+		{
+			TelemetryPolicyChanged(map, map->action[i] != best_action);
+			map->action[i] = best_action;
+			map->gap[i] = gap;
+		}
+
+		// Only a change larger than theta is worth passing on to the predecessors, each of which may see its residual
+		// move by as much as the change times the chance of reaching this cell, discounted
+		float change = fabsf(map->value[i] - old_v);
+		delta = fmaxf(delta, change);
+		if (change <= map->theta)
+		{
+			continue;
+		}
+		float residual = reach * change;
+
+		// A cell that can stay in place is its own predecessor
+		if (map->blocked[i] != 0)
+		{
+			QueueRaise(&queue, map, i, residual);
+		}
+
+		// The neighbour one step back along direction d reaches this cell if its move in direction d is not blocked
+		for (int d = 0; d < 8; d++)
+		{
+			size_t predecessor = i - transitions.offset[d];
+			if (map->cellType[predecessor] == OPEN && !(map->blocked[predecessor] >> d & 1))
+			{
+				QueueRaise(&queue, map, predecessor, residual);
+			}
+		}
+	}
+
+	// Report the work as the number of full sweeps it is equivalent to
+	map->iterations = open > 0 ? (int)((map->backups + open - 1) / open) : 0;
+	// An empty queue leaves no estimated residual above theta
+	map->stopReason = !more ? STOP_CALLBACK : queue.count == 0 ? STOP_CONVERGED : STOP_MAX_ITERATIONS;
+
+	free(queue.entries);
+	free(queue.position);
+
+	return true;
+}
+
+// Backs up the cell with the largest Bellman residual first, and rechecks its predecessors when its value changes
+void PrioritizedSweeping(Map *map)
+{
+	// If the queue could not be allocated, finish with ordinary sweeps from the values reached so far
+	if (!Prioritize(map, NULL, 0, false))
+	{
+		ComputeValueFunction(map);
+	}
+}
+
+// Prioritized sweeping that starts only from the given cells and their neighbours and records the policy as it goes
+bool PrioritizedSweepingFrom(Map *map, const size_t *seeds, size_t count)
+{
+	return Prioritize(map, seeds, count, true);
+}
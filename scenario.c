@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include "scenario.h"
+
+// Next number of a SplitMix64 generator, every grid has its own state so generation needs no global state
+static uint64_t RandomNext(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// Uniform number from 0 to bound - 1, by multiplying instead of taking a remainder and rejecting the few products
+// that would make some numbers more likely than others
+static uint32_t RandomBelow(uint64_t *state, uint32_t bound)
+{
+	uint64_t product = (RandomNext(state) >> 32) * bound;
+	uint32_t low = (uint32_t)product;
+	if (low < bound)
+	{
+		uint32_t threshold = -bound % bound;
+		while (low < threshold)
+		{
+			product = (RandomNext(state) >> 32) * bound;
+			low = (uint32_t)product;
+		}
+	}
+	return (uint32_t)(product >> 32);
+}
+
+// Replaces the grid of an allocated map with a generated one, returns false if the grid has more than 2^32 cells or
+// the generator's scratch space could not be allocated. The walls are drawn first, then obstructions, goals and holes
+// are placed on distinct cells off the walls with exact counts, and the map's other settings are left alone.
+bool ScenarioGenerate(Map *map, const Scenario *scenario)
+{
+	uint64_t cells = (uint64_t)map->width * map->height;
+	if (cells == 0 || cells > UINT32_MAX)
+	{
+		return false;
+	}
+
+	// Cells in the order they are picked, the first ones after the shuffle are the placed cells
+	uint32_t *order = malloc(cells * sizeof(uint32_t));
+	if (order == NULL)
+	{
+		return false;
+	}
+
+	GridClear(map);
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			map->cellType[MapIndex(map, x, y)] = OPEN;
+		}
+	}
+
+	// Walls stand in distinct columns, the gap of the first one is at the bottom
+	int walls = scenario->walls < 0 ? 0 : scenario->walls >= map->width ? map->width - 1 : scenario->walls;
+	for (int k = 0; k < walls; k++)
+	{
+		int x = (int)((int64_t)(k + 1) * map->width / (walls + 1));
+		for (int y = 0; y < map->height; y++)
+		{
+			if (y != (k % 2 == 0 ? map->height - 1 : 0))
+			{
+				map->cellType[MapIndex(map, x, y)] = OBSTRUCTION;
+			}
+		}
+	}
+
+	// Only the cells off the walls can be picked
+	uint32_t candidates = 0;
+	for (uint32_t i = 0; i < cells; i++)
+	{
+		if (map->cellType[MapIndex(map, i % map->width, i / map->width)] == OPEN)
+		{
+			order[candidates++] = i;
+		}
+	}
+
+	// Counts are capped so they always fit in the grid
+	float density = scenario->obstacleDensity < 0 ? 0 : scenario->obstacleDensity > 1 ? 1 : scenario->obstacleDensity;
+	uint32_t obstacles = (uint32_t)(candidates * density);
+	uint32_t goals = scenario->goals < 0 ? 0 : (uint32_t)scenario->goals;
+	uint32_t holes = scenario->holes < 0 ? 0 : (uint32_t)scenario->holes;
+	obstacles = obstacles < candidates ? obstacles : candidates;
+	goals = goals < candidates - obstacles ? goals : candidates - obstacles;
+	holes = holes < candidates - obstacles - goals ? holes : candidates - obstacles - goals;
+
+	// Partial Fisher-Yates shuffle, each pick is uniform over the cells not picked yet, so the work only depends on the
+	// number of cells placed and not on how crowded the grid already is
+	uint64_t state = scenario->seed;
+	uint32_t picks = obstacles + goals + holes;
+	for (uint32_t k = 0; k < picks; k++)
+	{
+		uint32_t j = k + RandomBelow(&state, candidates - k);
+		uint32_t cell = order[j];
+		order[j] = order[k];
+		order[k] = cell;
+
+		size_t i = MapIndex(map, cell % map->width, cell / map->width);
+		if (k < obstacles)
+		{
+			map->cellType[i] = OBSTRUCTION;
+		}
+		else if (k < obstacles + goals)
+		{
+			map->cellType[i] = GOAL;
+			map->value[i] = 100; // Goals have a high value
+		}
+		else
+		{
+			map->cellType[i] = HOLE;
+			map->value[i] = -100; // Holes have a low value
+		}
+	}
+
+	free(order);
+
+	TransitionTableInit(map);
+
+	// A new grid has to be solved from scratch
+	map->solved = false;
+	map->editCount = 0;
+
+	return true;
+}
@@ -0,0 +1,24 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdint.h>
+#include "valuefunction.h"
+
+// Settings of a generated grid, the same settings always give the same grid
+typedef struct Scenario
+{
+	uint64_t seed; // Seed of the generator's own random number generator
+	float obstacleDensity; // Fraction of the cells off the walls that are obstructions, rounded down to a whole number
+	int goals; // Number of goal cells
+	int holes; // Number of hole cells
+	// Number of walls from the top of the grid to the bottom, spread evenly across it, with a one cell gap at the bottom
+	// and top in turn so the open cells wind between them like a corridor
+	int walls;
+} Scenario;
+
+// Replaces the grid of an allocated map with a generated one, returns false if the grid has more than 2^32 cells or
+// the generator's scratch space could not be allocated. The walls are drawn first, then obstructions, goals and holes
+// are placed on distinct cells off the walls with exact counts, and the map's other settings are left alone.
+bool ScenarioGenerate(Map*, const Scenario*);
+
+#endif
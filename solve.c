@@ -0,0 +1,307 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+// make solve
+// ./solve [-w width] [-h height] [-s seed] [-o density] [-G goals] [-H holes] [-c walls] [-a solver] [-j threads]
+//         [-k sweeps] [-t csv|json] [-b maps] [-l file] [-u file] [-W file] [-r] [-e error] [-E epsilon]
+//         [-g gamma] [-i] [-q]
+// With -b the given number of maps, seeded from seed upwards, are solved together by ValueIterationBatch, each with the
+// solver options given, and no map file or telemetry
+// With -l the map is read from a map file instead of being generated, with -u the file is solved in place, and with
+// -W the solved map is written to a new map file. Only with -u does -a tiled keep just a band or two of the map resident
+// With -r Gauss-Seidel stores the values as bf16 for the early sweeps
+// With -e Gauss-Seidel also stops once its greedy policy is proven optimal or to lose at most error, needs gamma below 1
+// With -E the bounded solver stops once every value is known to within epsilon
+// With -i the values are seeded from the best paths to the goals and holes before solving
+#include <string.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "telemetry.h"
+#include "scenario.h"
+#include "mapfile.h"
+
+// Solver settings given on the command line, applied the same way to a single map and to every map of a batch
+typedef struct SolveOptions
+{
+	Solver solver;
+	int threads;
+	int evaluationSweeps; // Policy evaluation sweeps, the map's own if 0
+	bool reduced;
+	bool warm;
+	float valueError; // Loss of value accepted from the greedy policy, negative to only stop on the change in value
+	float epsilon; // Width the bounded solver narrows the values to, the map's own if negative
+	float gamma; // Discount factor, the map's own if negative
+} SolveOptions;
+
+// Writes the value and action of every cell to stdout
+void MapPrint(Map*);
+// Sets the solver settings of a map from the command line options
+void OptionsApply(Map*, const SolveOptions*);
+// Generates and solves count maps as one batch and writes the throughput to stdout
+int SolveBatch(int, int, int, unsigned int, Scenario, const SolveOptions*);
+
+int main(int argc, char **argv)
+{
+	int width = COLS;
+	int height = ROWS;
+	unsigned int seed = (unsigned int)time(0);
+	Scenario scenario = { .obstacleDensity = 0.1f, .goals = 0, .holes = 0 };
+	bool print = true;
+	SolveOptions options = { .solver = GAUSS_SEIDEL, .valueError = -1, .epsilon = -1, .gamma = -1 };
+	// Per-sweep records are written to stderr in this format, none if NULL
+	const char *format = NULL;
+	// Number of maps solved as one batch, 0 for a single map
+	int batch = 0;
+	// Map file read instead of generating a grid, and whether the solution is written back to it
+	const char *input = NULL;
+	bool inPlace = false;
+	// Map file the solved map is written to, none if NULL
+	const char *output = NULL;
+
+	// The kernel's instruction set was picked at build time, without it the first sweep would crash
+	if (!KernelSupported())
+	{
+		fprintf(stderr, "This CPU lacks the %s instructions %s was built for, rebuild it on this machine\n", KernelName(),
+			argv[0]);
+		return 1;
+	}
+
+	int option;
+	while ((option = getopt(argc, argv, "w:h:s:o:G:H:c:a:j:k:t:b:l:u:W:re:E:g:iq")) != -1)
+	{
+		switch (option)
+		{
+			case 'w': width = atoi(optarg); break;
+			case 'h': height = atoi(optarg); break;
+			case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+			case 'o': scenario.obstacleDensity = (float)atof(optarg); break;
+			case 'G': scenario.goals = atoi(optarg); break;
+			case 'H': scenario.holes = atoi(optarg); break;
+			case 'c': scenario.walls = atoi(optarg); break;
+			case 'j': options.threads = atoi(optarg); break;
+			case 'k': options.evaluationSweeps = atoi(optarg); break;
+			case 't': format = optarg; break;
+			case 'b': batch = atoi(optarg); break;
+			case 'l': input = optarg; inPlace = false; break;
+			case 'u': input = optarg; inPlace = true; break;
+			case 'W': output = optarg; break;
+			case 'r': options.reduced = true; break;
+			case 'e': options.valueError = (float)atof(optarg); break;
+			case 'E': options.epsilon = (float)atof(optarg); break;
+			case 'g': options.gamma = (float)atof(optarg); break;
+			case 'i': options.warm = true; break;
+			case 'q': print = false; break;
+			case 'a':
+				if (SolverFromName(optarg, &options.solver))
+				{
+					break;
+				}
+				fprintf(stderr, "Unknown solver %s\n", optarg);
+				return 1;
+			default:
+				fprintf(stderr, "usage: %s [-w width] [-h height] [-s seed] [-o density] [-G goals] [-H holes] [-c walls] "
+					"[-a solver] [-j threads] [-k sweeps] [-t csv|json] [-b maps] [-l file] [-u file] [-W file] [-r] [-e error] [-E epsilon] [-g gamma] [-i] [-q]\n",
+					argv[0]);
+				return 1;
+		}
+	}
+
+	if (batch > 0)
+	{
+		// A batch is generated and only reports its throughput, so there is no file to read or write nor a single solve
+		// to record
+		if (input != NULL || output != NULL || format != NULL)
+		{
+			fprintf(stderr, "-b cannot be combined with -l, -u, -W or -t\n");
+			return 1;
+		}
+		return SolveBatch(batch, width, height, seed, scenario, &options);
+	}
+
+	Map map;
+
+	if (input != NULL)
+	{
+		// The file's own parameters are kept, nothing is copied until the solve writes to it
+		if (!MapLoad(&map, input, inPlace))
+		{
+			fprintf(stderr, "Could not load map file %s\n", input);
+			return 1;
+		}
+	}
+	else
+	{
+		if (!MapAlloc(&map, width, height))
+		{
+			fprintf(stderr, "Could not allocate a %d x %d map\n", width, height);
+			return 1;
+		}
+
+		// The grid comes from the seed alone
+		MapDefaults(&map);
+		scenario.seed = seed;
+		if (!ScenarioGenerate(&map, &scenario))
+		{
+			fprintf(stderr, "Could not generate a %d x %d map\n", width, height);
+			MapFree(&map);
+			return 1;
+		}
+	}
+	OptionsApply(&map, &options);
+
+	Telemetry telemetry;
+	if (format != NULL)
+	{
+		if (strcmp(format, "csv") == 0)
+		{
+			TelemetryInit(&telemetry, CsvSink, stderr);
+			CsvHeader(stderr);
+		}
+		else if (strcmp(format, "json") == 0)
+		{
+			TelemetryInit(&telemetry, JsonLinesSink, stderr);
+		}
+		else
+		{
+			fprintf(stderr, "Unknown telemetry format %s\n", format);
+			MapFree(&map);
+			return 1;
+		}
+		map.telemetry = &telemetry;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ValueIteration(&map);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("seed %u solver %s kernel %s iterations %d improvements %d backups %lld seconds %.3f stop %s error_bound %g\n",
+		seed, SolverName(options.solver), KernelName(), map.iterations, map.improvements, map.backups,
+		(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9, StopReasonName(map.stopReason),
+		map.errorBound);
+	if (print)
+	{
+		MapPrint(&map);
+	}
+
+	int result = 0;
+	if (inPlace && !MapSync(&map))
+	{
+		fprintf(stderr, "Could not write map file %s\n", input);
+		result = 1;
+	}
+	if (output != NULL && !MapSave(&map, output))
+	{
+		fprintf(stderr, "Could not write map file %s\n", output);
+		result = 1;
+	}
+
+	MapFree(&map);
+
+	return result;
+}
+
+// Sets the solver settings of a map from the command line options
+void OptionsApply(Map *map, const SolveOptions *options)
+{
+	map->solver = options->solver;
+	map->threads = options->threads;
+	map->reducedPrecision = options->reduced;
+	map->warmStart = options->warm;
+	if (options->gamma >= 0)
+	{
+		map->gamma = options->gamma;
+	}
+	if (options->valueError >= 0)
+	{
+		map->stopRule = STOP_ON_POLICY;
+		map->valueError = options->valueError;
+	}
+	if (options->epsilon >= 0)
+	{
+		map->epsilon = options->epsilon;
+	}
+	if (options->evaluationSweeps > 0)
+	{
+		map->evaluationSweeps = options->evaluationSweeps;
+	}
+}
+
+// Generates and solves count maps as one batch and writes the throughput to stdout
+int SolveBatch(int count, int width, int height, unsigned int seed, Scenario scenario, const SolveOptions *options)
+{
+	Map *maps = calloc(count, sizeof(Map));
+	if (maps == NULL)
+	{
+		fprintf(stderr, "Could not allocate %d maps\n", count);
+		return 1;
+	}
+
+	// Map k comes from seed + k
+	int ready = 0;
+	while (ready < count && MapAlloc(&maps[ready], width, height))
+	{
+		MapDefaults(&maps[ready]);
+		scenario.seed = seed + (unsigned int)ready;
+		ScenarioGenerate(&maps[ready], &scenario);
+		OptionsApply(&maps[ready], options);
+		ready++;
+	}
+
+	int result = 1;
+	if (ready < count)
+	{
+		fprintf(stderr, "Could not allocate %d %d x %d maps\n", count, width, height);
+	}
+	else
+	{
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ValueIterationBatch(maps, count, options->threads);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+		long long iterations = 0;
+		for (int k = 0; k < count; k++)
+		{
+			iterations += maps[k].iterations;
+		}
+		printf("seed %u solver %s kernel %s maps %d iterations %lld seconds %.3f maps_per_second %.0f\n", seed,
+			SolverName(options->solver), KernelName(), count, iterations, seconds, seconds > 0 ? count / seconds : 0);
+		result = 0;
+	}
+
+	for (int k = 0; k < ready; k++)
+	{
+		MapFree(&maps[k]);
+	}
+	free(maps);
+
+	return result;
+}
+
+// Writes the value and action of every cell to stdout
+void MapPrint(Map *map)
+{
+	// Characters for the cell types, and arrows for the actions clockwise from the top
+	const char *types = ".GH#";
+	const char *arrows[9] = { "^", "/", ">", "\\", "v", "/", "<", "\\", " " };
+
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == OPEN)
+			{
+				printf("%8.1f%s", map->value[i], arrows[map->action[i]]);
+			}
+			else
+			{
+				printf("%8c ", types[map->cellType[i]]);
+			}
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,156 @@
+#include <math.h>
+#include <stdlib.h>
+#include "telemetry.h"
+
+// Sets up telemetry that sends records to sink, attach it by pointing the map's telemetry at it
+void TelemetryInit(Telemetry *telemetry, TelemetrySink sink, void *context)
+{
+	telemetry->sink = sink;
+	telemetry->context = context;
+	telemetry->backups = 0;
+	telemetry->sweep = 0;
+	telemetry->continuing = false;
+	telemetry->policy = false;
+	atomic_init(&telemetry->changes, 0);
+	clock_gettime(CLOCK_MONOTONIC, &telemetry->last);
+}
+
+#ifndef NO_TELEMETRY
+// Starts the records of a solve of the map, policy is set if the solver records the policy as it sweeps
+void TelemetryStart(Map *map, bool policy)
+{
+	Telemetry *telemetry = map->telemetry;
+	if (telemetry == NULL)
+	{
+		return;
+	}
+
+	// Solvers count backups from 0, a later stage of a solve numbers its sweeps on from the earlier stages
+	if (!telemetry->continuing)
+	{
+		telemetry->sweep = 0;
+	}
+	telemetry->continuing = false;
+	telemetry->backups = 0;
+	telemetry->policy = policy;
+	atomic_store_explicit(&telemetry->changes, 0, memory_order_relaxed);
+
+	clock_gettime(CLOCK_MONOTONIC, &telemetry->last);
+}
+
+// Makes the next start of the map's records a later stage of the current solve, so its sweeps are numbered on from
+// the ones recorded so far
+void TelemetryContinue(Map *map)
+{
+	if (map->telemetry != NULL)
+	{
+		map->telemetry->continuing = true;
+	}
+}
+
+// Records the sweep just made, delta is its largest change
+void TelemetrySweep(Map *map, float delta)
+{
+	Telemetry *telemetry = map->telemetry;
+	if (telemetry == NULL)
+	{
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	SweepRecord record;
+	record.sweep = ++telemetry->sweep;
+	record.delta = delta;
+	record.seconds = (now.tv_sec - telemetry->last.tv_sec) + (now.tv_nsec - telemetry->last.tv_nsec) * 1e-9;
+	record.cells = map->backups - telemetry->backups;
+	record.backupsPerSecond = record.seconds > 0 ? record.cells / record.seconds : 0;
+	// The solvers count the actions they change as they write them, so only the count is taken here
+	long long changes = atomic_exchange_explicit(&telemetry->changes, 0, memory_order_relaxed);
+	record.policyChanges = telemetry->policy ? changes : -1;
+
+	telemetry->sink(telemetry->context, &record);
+
+	// The sink's own time is not counted in the next sweep
+	telemetry->backups = map->backups;
+	clock_gettime(CLOCK_MONOTONIC, &telemetry->last);
+}
+#endif
+
+// Allocates a ring of the given number of records, returns false if it could not be allocated
+bool RingSinkInit(RingSink *ring, size_t capacity)
+{
+	ring->records = capacity > 0 ? malloc(capacity * sizeof(SweepRecord)) : NULL;
+	ring->capacity = ring->records != NULL ? capacity : 0;
+	ring->count = 0;
+	return ring->records != NULL;
+}
+
+// Releases the records of a ring
+void RingSinkFree(RingSink *ring)
+{
+	free(ring->records);
+	ring->records = NULL;
+	ring->capacity = 0;
+	ring->count = 0;
+}
+
+// Sink that keeps the record in a RingSink
+void RingSinkRecord(void *context, const SweepRecord *record)
+{
+	RingSink *ring = context;
+	ring->records[ring->count % ring->capacity] = *record;
+	ring->count++;
+}
+
+// Returns a kept record, 0 is the oldest, NULL if there is no such record
+const SweepRecord *RingSinkGet(const RingSink *ring, size_t i)
+{
+	size_t kept = ring->count < ring->capacity ? ring->count : ring->capacity;
+	if (i >= kept)
+	{
+		return NULL;
+	}
+	return &ring->records[(ring->count - kept + i) % ring->capacity];
+}
+
+// Writes the column names of CsvSink to a file
+void CsvHeader(FILE *file)
+{
+	fprintf(file, "sweep,delta,seconds,cells,backups_per_second,policy_changes\n");
+}
+
+// Sink that writes the record as a line of comma-separated values to a FILE
+void CsvSink(void *context, const SweepRecord *record)
+{
+	fprintf(context, "%d,%g,%.9f,%lld,%.0f,%lld\n", record->sweep, record->delta, record->seconds, record->cells,
+		record->backupsPerSecond, record->policyChanges);
+}
+
+// Writes a JSON member with a number in the given format, JSON has no infinity or NaN so those are written as null
+static void JsonNumber(FILE *file, const char *name, const char *format, double value)
+{
+	fprintf(file, "\"%s\":", name);
+	if (isfinite(value))
+	{
+		fprintf(file, format, value);
+	}
+	else
+	{
+		fprintf(file, "null");
+	}
+}
+
+// Sink that writes the record as a JSON object on its own line to a FILE
+void JsonLinesSink(void *context, const SweepRecord *record)
+{
+	FILE *file = context;
+	fprintf(file, "{\"sweep\":%d,", record->sweep);
+	JsonNumber(file, "delta", "%g", record->delta);
+	fprintf(file, ",");
+	JsonNumber(file, "seconds", "%.9f", record->seconds);
+	fprintf(file, ",\"cells\":%lld,", record->cells);
+	JsonNumber(file, "backups_per_second", "%.0f", record->backupsPerSecond);
+	fprintf(file, ",\"policy_changes\":%lld}\n", record->policyChanges);
+}
@@ -0,0 +1,89 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include "valuefunction.h"
+
+// Statistics of one sweep of a solve, or of one sweep's worth of prioritized backups
+typedef struct SweepRecord
+{
+	int sweep; // Sweeps made so far in the solve, counting this one
+	float delta; // Largest change in value
+	double seconds; // Wall time since the previous record, or since the solve started
+	long long cells; // Cells backed up
+	double backupsPerSecond; // Cells backed up per second of wall time
+	// Actions changed as they were written, so a cell the tiled solver changes on two sweeps of a band counts twice, -1 if
+	// the solver does not record the policy as it sweeps
+	long long policyChanges;
+} SweepRecord;
+
+// Receives each record, context is the sink's own state
+typedef void (*TelemetrySink)(void *context, const SweepRecord*);
+
+// Sink attached to a map and the state it needs between sweeps
+typedef struct Telemetry
+{
+	TelemetrySink sink;
+	void *context; // Passed to the sink
+	struct timespec last; // When the previous record was made
+	long long backups; // Backups of the map at the previous record
+	int sweep; // Records made in the current solve
+	bool continuing; // The next start is a later stage of the current solve, whose records carry on from this one's
+	bool policy; // The current solve records the policy, so changes are counted
+	atomic_llong changes; // Actions changed since the previous record, added up by the solvers as they write them
+} Telemetry;
+
+// Last records of a solve, kept in memory
+typedef struct RingSink
+{
+	SweepRecord *records;
+	size_t capacity; // Records kept, older ones are overwritten
+	size_t count; // Records written since the ring was initialised
+} RingSink;
+
+// Sets up telemetry that sends records to sink, attach it by pointing the map's telemetry at it
+void TelemetryInit(Telemetry*, TelemetrySink, void*);
+
+// Solvers call these when compiled with telemetry, defining NO_TELEMETRY removes them entirely
+#ifdef NO_TELEMETRY
+#define TelemetryStart(map, policy) ((void)0)
+#define TelemetrySweep(map, delta) ((void)0)
+#define TelemetryContinue(map) ((void)0)
+#define TelemetryPolicyChanged(map, changes) ((void)0)
+#else
+// Starts the records of a solve of the map, policy is set if the solver records the policy as it sweeps
+void TelemetryStart(Map*, bool);
+// Records the sweep just made, delta is its largest change
+void TelemetrySweep(Map*, float);
+// Makes the next start of the map's records a later stage of the current solve, so its sweeps are numbered on from
+// the ones recorded so far
+void TelemetryContinue(Map*);
+
+// Adds actions a solver changed as it wrote the policy to the next record, from any thread
+static inline void TelemetryPolicyChanged(const Map *map, long long changes)
+{
+	if (changes > 0 && map->telemetry != NULL)
+	{
+		atomic_fetch_add_explicit(&map->telemetry->changes, changes, memory_order_relaxed);
+	}
+}
+#endif
+
+// Allocates a ring of the given number of records, returns false if it could not be allocated
+bool RingSinkInit(RingSink*, size_t);
+// Releases the records of a ring
+void RingSinkFree(RingSink*);
+// Sink that keeps the record in a RingSink
+void RingSinkRecord(void*, const SweepRecord*);
+// Returns a kept record, 0 is the oldest, NULL if there is no such record
+const SweepRecord *RingSinkGet(const RingSink*, size_t);
+// Writes the column names of CsvSink to a file
+void CsvHeader(FILE*);
+// Sink that writes the record as a line of comma-separated values to a FILE
+void CsvSink(void*, const SweepRecord*);
+// Sink that writes the record as a JSON object on its own line to a FILE
+void JsonLinesSink(void*, const SweepRecord*);
+
+#endif
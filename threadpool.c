@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+// Arguments handed to a worker thread when it starts
+typedef struct Worker
+{
+	ThreadPool *pool;
+	int thread;
+} Worker;
+
+// Returns the number of threads to use, all online cores if requested is 0 or less
+int ThreadCount(int requested)
+{
+	if (requested > 0)
+	{
+		return requested;
+	}
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
+
+// Waits for tasks and runs them until the pool is stopped
+static void *WorkerMain(void *argument)
+{
+	Worker worker = *(Worker*)argument;
+	ThreadPool *pool = worker.pool;
+	unsigned long generation = 0;
+	free(argument);
+
+	pthread_mutex_lock(&pool->lock);
+	while (true)
+	{
+		while (!pool->stop && pool->generation == generation)
+		{
+			pthread_cond_wait(&pool->start, &pool->lock);
+		}
+		if (pool->stop)
+		{
+			break;
+		}
+		generation = pool->generation;
+		ThreadTask task = pool->task;
+		void *context = pool->context;
+		pthread_mutex_unlock(&pool->lock);
+
+		task(context, worker.thread, pool->threads);
+
+		pthread_mutex_lock(&pool->lock);
+		// The last worker to finish wakes the caller
+		if (--pool->running == 0)
+		{
+			pthread_cond_signal(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+// Starts the worker threads, returns false if they could not be created
+bool ThreadPoolInit(ThreadPool *pool, int threads)
+{
+	pool->threads = 1;
+	pool->workers = threads > 1 ? malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+	pool->task = NULL;
+	pool->context = NULL;
+	pool->generation = 0;
+	pool->running = 0;
+	pool->stop = false;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	if (threads > 1 && pool->workers == NULL)
+	{
+		ThreadPoolFree(pool);
+		return false;
+	}
+
+	for (int thread = 1; thread < threads; thread++)
+	{
+		Worker *worker = malloc(sizeof(Worker));
+		if (worker == NULL)
+		{
+			ThreadPoolFree(pool);
+			return false;
+		}
+		*worker = (Worker){ .pool = pool, .thread = thread };
+		if (pthread_create(&pool->workers[thread - 1], NULL, WorkerMain, worker) != 0)
+		{
+			free(worker);
+			ThreadPoolFree(pool);
+			return false;
+		}
+		pool->threads++;
+	}
+
+	return true;
+}
+
+// Runs the task on every thread of the pool and returns when all of them have finished
+void ThreadPoolRun(ThreadPool *pool, ThreadTask task, void *context)
+{
+	if (pool->threads > 1)
+	{
+		pthread_mutex_lock(&pool->lock);
+		pool->task = task;
+		pool->context = context;
+		pool->running = pool->threads - 1;
+		pool->generation++;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	// The caller does the share of thread 0
+	task(context, 0, pool->threads);
+
+	if (pool->threads > 1)
+	{
+		pthread_mutex_lock(&pool->lock);
+		while (pool->running > 0)
+		{
+			pthread_cond_wait(&pool->done, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+// Stops and joins the worker threads
+void ThreadPoolFree(ThreadPool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int thread = 1; thread < pool->threads; thread++)
+	{
+		pthread_join(pool->workers[thread - 1], NULL);
+	}
+
+	free(pool->workers);
+	pool->workers = NULL;
+	pool->threads = 0;
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+}
@@ -0,0 +1,35 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Work run on every thread of the pool, thread is 0 to threads - 1
+typedef void (*ThreadTask)(void *context, int thread, int threads);
+
+// Fixed set of worker threads that all run the same task and wait for each other to finish it
+// The calling thread takes part as thread 0, so a pool of one thread starts no workers
+typedef struct ThreadPool
+{
+	int threads; // Number of threads including the caller
+	pthread_t *workers; // threads - 1 worker threads
+	pthread_mutex_t lock;
+	pthread_cond_t start; // Signalled when a new task is posted
+	pthread_cond_t done; // Signalled when the last worker finishes a task
+	ThreadTask task; // Current task
+	void *context; // Argument of the current task
+	unsigned long generation; // Incremented for every task posted
+	int running; // Workers still busy with the current task
+	bool stop; // Set when the workers should exit
+} ThreadPool;
+
+// Returns the number of threads to use, all online cores if requested is 0 or less
+int ThreadCount(int);
+// Starts the worker threads, returns false if they could not be created
+bool ThreadPoolInit(ThreadPool*, int);
+// Runs the task on every thread of the pool and returns when all of them have finished
+void ThreadPoolRun(ThreadPool*, ThreadTask, void*);
+// Stops and joins the worker threads
+void ThreadPoolFree(ThreadPool*);
+
+#endif
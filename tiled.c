@@ -0,0 +1,135 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "telemetry.h"
+
+// Bytes of plane memory a tile covers when the map does not set its own tile height
+#define TILE_DEFAULT_BYTES (64 << 20)
+
+// Gives the kernel a hint about the rows first to last - 1 of every plane of a file-backed map
+// Pages are only whole pages inside the rows, so no page holding a row outside them is released
+static void TileAdvise(const Map *map, int first, int last, int advice)
+{
+	if (map->mapping == NULL || first >= last)
+	{
+		return;
+	}
+
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const void *planes[6] = { map->value, map->gap, map->cellType, map->action, map->blocked, map->collide };
+	size_t sizes[6] = { sizeof(float), sizeof(float), 1, 1, 1, 1 };
+	for (int p = 0; p < 6; p++)
+	{
+		uintptr_t begin = (uintptr_t)planes[p] + MapIndex(map, -1, first) * sizes[p];
+		uintptr_t end = (uintptr_t)planes[p] + MapIndex(map, -1, last) * sizes[p];
+		if (advice == MADV_WILLNEED)
+		{
+			// Prefetching can round outwards
+			begin = begin / page * page;
+		}
+		else
+		{
+			begin = (begin + page - 1) / page * page;
+			end = end / page * page;
+		}
+		if (begin < end)
+		{
+			// Written pages are only clean once flushed, and only a shared mapping can flush them
+			if (advice == MADV_DONTNEED)
+			{
+				msync((void*)begin, end - begin, MS_SYNC);
+			}
+			madvise((void*)begin, end - begin, advice);
+		}
+	}
+}
+
+// Sweeps the grid one band of rows at a time, running up to tileSweeps sweeps over a band while its pages are resident
+// before moving on. A band reads the rows either side of it, its halo, straight from the neighbouring bands, so they
+// always see each other's latest values. The first sweep over each band, taken in order, is a Gauss-Seidel sweep of
+// the whole grid, and its largest change is the one tested against theta, so the solve stops where
+// ComputeValueFunction would. On a map loaded by MapLoad the next band is prefetched. On one loaded with shared set the
+// finished band is also flushed to the file and dropped, which keeps only a band or two resident. The pages of a
+// private mapping have nowhere to go without swap once written, so they stay.
+void ComputeValueFunctionTiled(Map *map)
+{
+	bool loop = true;
+	int iterations = 0;
+	long long backups = 0;
+	Transitions transitions;
+
+	TransitionsInit(&transitions, map);
+	TelemetryStart(map, map->fusedPolicy);
+
+	// Rows of a band, from the map or from the memory the planes of a row take
+	size_t rowBytes = (size_t)map->stride * (2 * sizeof(float) + 4);
+	int rows = map->tileRows > 0 ? map->tileRows : (int)(TILE_DEFAULT_BYTES / rowBytes);
+	rows = rows < 1 ? 1 : rows > map->height ? map->height : rows;
+	int sweeps = map->tileSweeps > 0 ? map->tileSweeps : 1;
+
+	while (loop == true)
+	{
+		float delta = 0;
+
+		for (int begin = 0; begin < map->height; begin += rows)
+		{
+			int end = begin + rows < map->height ? begin + rows : map->height;
+
+			// The next band, wrapping round to the first one for the next pass, is read in while this one is swept
+			int next = end < map->height ? end : 0;
+			TileAdvise(map, next - 1 < 0 ? 0 : next - 1, next + rows + 1 < map->height ? next + rows + 1 : map->height,
+				MADV_WILLNEED);
+
+			long long open = 0;
+			for (int y = begin; y < end; y++)
+			{
+				for (int x = 0; x < map->width; x++)
+				{
+					open += map->cellType[MapIndex(map, x, y)] == OPEN;
+				}
+			}
+
+			for (int sweep = 0; sweep < sweeps; sweep++)
+			{
+				float tileDelta = 0;
+				for (int y = begin; y < end; y++)
+				{
+					float row_delta = BackupRow(&transitions, map, map->value, map->value, map->fusedPolicy, y, 0, map->width);
+					tileDelta = row_delta > tileDelta ? row_delta : tileDelta;
+				}
+				backups += open;
+
+				// Only the first sweep is part of the pass, the others just make the most of the band being resident
+				if (sweep == 0 && tileDelta > delta)
+				{
+					delta = tileDelta;
+				}
+				if (tileDelta < map->theta)
+				{
+					break;
+				}
+			}
+
+			// The band's last row is the next band's halo, so it stays
+			if (map->mappingShared)
+			{
+				TileAdvise(map, begin - 1 < 0 ? 0 : begin - 1, end - 1, MADV_DONTNEED);
+			}
+		}
+
+		// Increment iteration count
+		iterations += 1;
+		map->iterations = iterations;
+		map->backups = backups;
+
+		// Terminate the loop on convergence, when the maximum number of iterations is met or when the sweep callback
+		// asks to stop
+		bool more = SweepDone(map, delta);
+		map->stopReason = SweepStopReason(map, iterations, delta, more);
+		if (map->stopReason != STOP_NONE)
+		{
+			loop = false;
+		}
+	}
+}
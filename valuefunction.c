@@ -0,0 +1,570 @@
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "valuefunction.h"
+#include "kernel.h"
+#include "telemetry.h"
+
+// Names of the reasons a solve stops, in StopReason order
+static const char *stopReasonNames[] = { "none", "converged", "policy-optimal", "value-error", "interval",
+	"stalled", "max-iterations", "callback" };
+
+// Command line names of the solvers, in Solver order
+static const char *solverNames[] = { "gauss-seidel", "jacobi", "red-black", "prioritized", "policy", "modified-policy", "multigrid",
+	"tiled", "bounded", "fast-sweeping" };
+
+// Column and row change for a move in each direction, clockwise with 0 at top
+static const int directionX[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+static const int directionY[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+
+// Cycles a cell through the different cell types
+void ChangeCellType(Map *map, int x, int y)
+{
+	size_t i = MapIndex(map, x, y);
+    if (map->cellType[i] == OPEN)
+    {
+        map->cellType[i] = GOAL;
+	map->value[i] = 100; // Goals have a high value
+    }
+    else if (map->cellType[i] == GOAL)
+    {
+        map->cellType[i] = HOLE;
+	map->value[i] = -100; // Holes have a low value
+    }
+    else if (map->cellType[i] == HOLE)
+    {
+        map->cellType[i] = OBSTRUCTION;
+	map->value[i] = 0;
+    }
+    else if (map->cellType[i] == OBSTRUCTION)
+    {
+        map->cellType[i] = OPEN;
+    }
+	// Moves into and out of the neighbouring cells may have changed
+	TransitionTableUpdate(map, x, y);
+
+	// Remember the edit so the next incremental solve can start from it, without the record only a full solve is correct
+	if (!MapRecordEdit(map, i))
+	{
+		map->solved = false;
+	}
+}
+
+// Adds a plane index to the edits of the next incremental solve, returns false if the list could not grow
+bool MapRecordEdit(Map *map, size_t i)
+{
+	if (map->editCount == map->editCapacity)
+	{
+		size_t capacity = map->editCapacity > 0 ? 2 * map->editCapacity : 16;
+		size_t *edits = realloc(map->edits, capacity * sizeof(size_t));
+		if (edits == NULL)
+		{
+			return false;
+		}
+		map->edits = edits;
+		map->editCapacity = capacity;
+	}
+	map->edits[map->editCount++] = i;
+	return true;
+}
+
+// Reports a finished sweep and its largest change to the telemetry and the sweep callback, returns false if the solve
+// should stop
+bool SweepDone(Map *map, float delta)
+{
+	TelemetrySweep(map, delta);
+	return map->sweepCallback == NULL || map->sweepCallback(map, map->sweepContext);
+}
+
+// Returns why a solve should stop after its given number of sweeps, the largest change of the last one and what the
+// sweep callback returned, STOP_NONE if it should carry on
+StopReason SweepStopReason(const Map *map, int iterations, float delta, bool more)
+{
+	if (delta < map->theta)
+	{
+		return STOP_CONVERGED;
+	}
+	if (iterations > map->max_iterations)
+	{
+		return STOP_MAX_ITERATIONS;
+	}
+	return more ? STOP_NONE : STOP_CALLBACK;
+}
+
+// Checks that the index is suitable
+bool IndexIsValid(const Map *map, int x, int y)
+{
+	return x >= 0 && x < map->width && y >= 0 && y < map->height;
+}
+
+// Rounds a plane size up to a whole number of alignment blocks
+static size_t PlaneSize(size_t size)
+{
+	return (size + MAP_ALIGNMENT - 1) / MAP_ALIGNMENT * MAP_ALIGNMENT;
+}
+
+// Returns the size in bytes of the block holding the planes of a width x height grid
+size_t MapBlockSize(int width, int height)
+{
+	size_t cells = (size_t)(width + 2) * (height + 2);
+	return 2 * PlaneSize(cells * sizeof(float)) + 4 * PlaneSize(cells * sizeof(uint8_t));
+}
+
+// Points the planes of a width x height grid into a block of MapBlockSize bytes, in the order value, action gap, cell
+// type, action, blocked and collide, each starting on its own alignment boundary
+void MapAttach(Map *map, int width, int height, void *memory)
+{
+	size_t cells = (size_t)(width + 2) * (height + 2);
+	size_t valueSize = PlaneSize(cells * sizeof(float));
+	size_t byteSize = PlaneSize(cells * sizeof(uint8_t));
+
+	map->width = width;
+	map->height = height;
+	map->stride = width + 2;
+	map->solved = false;
+	map->edits = NULL;
+	map->editCount = 0;
+	map->editCapacity = 0;
+	map->sweepCallback = NULL;
+	map->sweepContext = NULL;
+	map->telemetry = NULL;
+	map->mapping = NULL;
+	map->mappingSize = 0;
+	map->mappingShared = false;
+	map->memory = memory;
+	if (memory == NULL)
+	{
+		map->value = NULL;
+		map->gap = NULL;
+		map->cellType = NULL;
+		map->action = NULL;
+		map->blocked = NULL;
+		map->collide = NULL;
+		return;
+	}
+
+	map->value = memory;
+	map->gap = (float*)((uint8_t*)memory + valueSize);
+	map->cellType = (uint8_t*)memory + 2 * valueSize;
+	map->action = (uint8_t*)memory + 2 * valueSize + byteSize;
+	map->blocked = (uint8_t*)memory + 2 * valueSize + 2 * byteSize;
+	map->collide = (uint8_t*)memory + 2 * valueSize + 3 * byteSize;
+}
+
+// Allocates the value, action gap, cell type, action and transition planes of a width x height grid as one aligned block
+bool MapAlloc(Map *map, int width, int height)
+{
+	void *memory = width > 0 && height > 0 ? aligned_alloc(MAP_ALIGNMENT, MapBlockSize(width, height)) : NULL;
+	MapAttach(map, width, height, memory);
+	return memory != NULL;
+}
+
+// Releases the planes allocated by MapAlloc or mapped by MapLoad
+void MapFree(Map *map)
+{
+	if (map->mapping != NULL)
+	{
+		munmap(map->mapping, map->mappingSize);
+	}
+	else
+	{
+		free(map->memory);
+	}
+	free(map->edits);
+	map->memory = NULL;
+	map->mapping = NULL;
+	map->mappingSize = 0;
+	map->mappingShared = false;
+	map->edits = NULL;
+	map->editCount = 0;
+	map->editCapacity = 0;
+	map->value = NULL;
+	map->gap = NULL;
+	map->cellType = NULL;
+	map->action = NULL;
+	map->blocked = NULL;
+	map->collide = NULL;
+	map->width = 0;
+	map->height = 0;
+	map->stride = 0;
+}
+
+// Makes every cell, including the ghost border, an obstruction with no value or action
+void GridClear(Map *map)
+{
+	// The ghost border is never updated, it only gives moves off the edge somewhere to read
+	size_t cells = MapPlaneLength(map);
+	for (size_t i = 0; i < cells; i++)
+	{
+		map->cellType[i] = OBSTRUCTION;
+		map->value[i] = 0;
+		map->gap[i] = 0;
+		map->action[i] = 8;
+		map->blocked[i] = 0;
+		map->collide[i] = 0;
+	}
+}
+
+// Initialises each grid and adds random obstacles
+void GridInit(Map *map)
+{
+	GridClear(map);
+
+	// Gives initial value to each cell
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			map->cellType[MapIndex(map, x, y)] = OPEN;
+		}
+	}
+
+	// Randomly adds obstacles, obstacleDensity of the cells
+	float density = map->obstacleDensity < 0 ? 0 : map->obstacleDensity > 1 ? 1 : map->obstacleDensity;
+	int obstaclesPresent = (int)((float)map->width * map->height * density);
+	int obstaclesToPlace = obstaclesPresent;
+	while (obstaclesToPlace > 0)
+	{
+		int x = rand() % map->width;
+		int y = rand() % map->height;
+
+		if (map->cellType[MapIndex(map, x, y)] == OPEN)
+		{
+			map->cellType[MapIndex(map, x, y)] = OBSTRUCTION;
+			obstaclesToPlace--;
+		}
+	}
+
+	TransitionTableInit(map);
+
+	// A new grid has to be solved from scratch
+	map->solved = false;
+	map->editCount = 0;
+}
+
+// Builds the blocked and collide masks of one cell
+static void CellTransitions(Map *map, int x, int y)
+{
+	uint8_t blocked = 0;
+	uint8_t collide = 0;
+	for (int d = 0; d < 8; d++)
+	{
+		int new_x = x + directionX[d];
+		int new_y = y + directionY[d];
+		// Moving off the grid leaves the cell in place, moving into an obstruction also collides
+		if (!IndexIsValid(map, new_x, new_y))
+		{
+			blocked |= 1 << d;
+		}
+		else if (map->cellType[MapIndex(map, new_x, new_y)] == OBSTRUCTION)
+		{
+			blocked |= 1 << d;
+			collide |= 1 << d;
+		}
+	}
+	map->blocked[MapIndex(map, x, y)] = blocked;
+	map->collide[MapIndex(map, x, y)] = collide;
+}
+
+// Builds the blocked and collide masks of every cell
+void TransitionTableInit(Map *map)
+{
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			CellTransitions(map, x, y);
+		}
+	}
+}
+
+// Rebuilds the blocked and collide masks of the cells next to an edited cell
+void TransitionTableUpdate(Map *map, int x, int y)
+{
+	for (int new_y = y - 1; new_y <= y + 1; new_y++)
+	{
+		for (int new_x = x - 1; new_x <= x + 1; new_x++)
+		{
+			if (IndexIsValid(map, new_x, new_y))
+			{
+				CellTransitions(map, new_x, new_y);
+			}
+		}
+	}
+}
+
+// Fills the shared successor offsets, rewards and probabilities from the map parameters
+void TransitionsInit(Transitions *transitions, const Map *map)
+{
+	for (int d = 0; d < 8; d++)
+	{
+		transitions->offset[d] = (ptrdiff_t)directionY[d] * map->stride + directionX[d];
+		// Diagonal moves cost 1.4 times the movement penalty, truncated to a whole number as before
+		transitions->reward[d] = d % 2 == 1 ? (int)(1.4 * map->movementPenalty) : map->movementPenalty;
+	}
+	transitions->collision = map->collisionPenalty;
+	transitions->probability[0] = (1 - map->probability)/2;
+	transitions->probability[1] = map->probability;
+	transitions->probability[2] = (1 - map->probability)/2;
+	transitions->gamma = map->gamma;
+}
+
+// Initialises the map
+void MapInit(Map *map)
+{
+	MapDefaults(map);
+	GridInit(map);
+}
+
+// Sets the solver parameters and settings to their defaults, leaving the grid alone
+void MapDefaults(Map *map)
+{
+	map->theta = 1e-6;
+	map->probability = 0.8;
+	map->gamma = 1;
+	map->max_iterations = 100;
+	map->movementPenalty = -10;
+	map->collisionPenalty = -50;
+	map->obstacleDensity = 0.1f;
+	map->solver = GAUSS_SEIDEL;
+	map->warmStart = false;
+	map->reducedPrecision = false;
+	map->fusedPolicy = true;
+	map->evaluationSweeps = 5;
+	map->tileRows = 0;
+	map->tileSweeps = 4;
+	map->stopRule = STOP_ON_DELTA;
+	map->valueError = 0;
+	map->epsilon = 0.01f;
+	map->stopReason = STOP_NONE;
+	map->errorBound = INFINITY;
+	map->threads = 0;
+	map->iterations = 0;
+	map->improvements = 0;
+	map->backups = 0;
+}
+
+void ValueIteration(Map *map)
+{
+	// Value function calculated first, the sweeps record the policy as well if fusedPolicy is set
+	bool policy = map->fusedPolicy;
+	map->stopReason = STOP_NONE;
+	map->errorBound = INFINITY;
+	// The bounded and fast-sweeping solvers start an unsolved map from bounds of their own, and multigrid starts it from
+	// the coarse grid's values, which would overwrite the seeded ones
+	if (map->warmStart && !map->solved && map->solver != BOUNDED && map->solver != FAST_SWEEPING &&
+		map->solver != MULTIGRID)
+	{
+		WarmStart(map);
+	}
+	switch (map->solver)
+	{
+		case JACOBI: ComputeValueFunctionJacobi(map); break;
+		case RED_BLACK: ComputeValueFunctionRedBlack(map); break;
+		case PRIORITIZED: PrioritizedSweeping(map); policy = false; break;
+		case POLICY_ITERATION: PolicyIteration(map); policy = true; break;
+		case MODIFIED_POLICY_ITERATION: ModifiedPolicyIteration(map); policy = true; break;
+		case MULTIGRID: Multigrid(map); break;
+		case TILED: ComputeValueFunctionTiled(map); break;
+		case BOUNDED: BoundedValueIteration(map); policy = false; break;
+		default: map->reducedPrecision ? ComputeValueFunctionReduced(map) : ComputeValueFunction(map); break;
+	}
+	// Then optimal actions are found, unless the solver already recorded them
+	if (!policy)
+	{
+		ExtractPolicy(map);
+	}
+
+	map->solved = true;
+	map->editCount = 0;
+}
+
+// Re-solves from the current values, only spreading out from the cells edited since the last solve
+void ValueIterationIncremental(Map *map)
+{
+	// Nothing to start from, or nothing changed
+	if (!map->solved)
+	{
+		ValueIteration(map);
+		return;
+	}
+	if (map->editCount == 0)
+	{
+		map->iterations = 0;
+		map->backups = 0;
+		return;
+	}
+
+	if (!PrioritizedSweepingFrom(map, map->edits, map->editCount))
+	{
+		ValueIteration(map);
+		return;
+	}
+
+	map->editCount = 0;
+}
+
+// Loops through grid updating cell values
+void ComputeValueFunction(Map *map)
+{
+	bool loop = true;
+	float delta;
+	int iterations = 0;
+	long long open = CountOpenCells(map);
+	Transitions transitions;
+
+	TransitionsInit(&transitions, map);
+	TelemetryStart(map, map->fusedPolicy);
+
+	// The policy rule needs a discount below 1 for its bound and a plane for its Jacobi sweeps, without them only the
+	// change in value is tested
+	float *scratch = NULL;
+	if (map->stopRule == STOP_ON_POLICY && map->gamma < 1)
+	{
+		scratch = aligned_alloc(MAP_ALIGNMENT, PlaneSize(MapPlaneLength(map) * sizeof(float)));
+	}
+	// Smallest action gap seen by the last certification, none has been made yet
+	float gap = INFINITY;
+	bool certified = false;
+	float last_delta = INFINITY;
+	// Fast sweeping turns the sweep round every time, the rows run up on odd sweeps and the columns run left on the
+	// second and third of every four, so values spread across the grid in every direction within a few sweeps. Values
+	// only spread that way while they rise, falling ones drop by at most a move's penalty a sweep whatever the order,
+	// so an unsolved map starts from the lower bound of the bounded solver, which is finite wherever a terminal can be
+	// reached and leaves the other cells as they were.
+	bool alternate = map->solver == FAST_SWEEPING;
+	if (alternate && !map->solved)
+	{
+		ValueBoundsInit(map, &transitions, NULL);
+	}
+
+	while (loop == true)
+	{
+		delta = 0;
+		StopReason reason = STOP_NONE;
+
+		// A sweep is spent on certifying the policy only if the last sweep's change could leave the bound below the
+		// action gap or the accepted error, and never twice in a row
+		float bound = 2 * map->gamma * last_delta / (1 - map->gamma);
+		if (scratch != NULL && !certified && iterations > 0 && (bound < gap || bound / (1 - map->gamma) <= map->valueError))
+		{
+			reason = CertifyPolicy(map, &transitions, scratch, &delta, &gap);
+			certified = true;
+		}
+		else
+		{
+			certified = false;
+			bool up = alternate && iterations % 2 == 1;
+			bool left = alternate && (iterations + 1) % 4 >= 2;
+			// Sweep systematically over the cells
+			for (int row = 0; row < map->height; row++)
+			{
+				// Each row is backed up in place, the kernel skips obstructions, holes and goals
+				int y = up ? map->height - 1 - row : row;
+				float row_delta = left ?
+					BackupRowReverse(&transitions, map, map->value, map->value, map->fusedPolicy, y, 0, map->width) :
+					BackupRow(&transitions, map, map->value, map->value, map->fusedPolicy, y, 0, map->width);
+
+				// Update the maximum deviation
+				if (row_delta > delta)
+				{
+					delta = row_delta;
+				}
+			}
+		}
+		last_delta = delta;
+
+		// Increment iteration count
+		iterations += 1;
+		map->iterations = iterations;
+		map->backups = iterations * open;
+
+		// Terminate the loop on convergence, when the maximum number of iterations is met, when the sweep callback asks
+		// to stop or once the policy is certified
+		bool more = SweepDone(map, delta);
+		map->stopReason = reason != STOP_NONE ? reason : SweepStopReason(map, iterations, delta, more);
+		if (map->stopReason != STOP_NONE)
+		{
+			loop = false;
+		}
+	}
+
+	free(scratch);
+}
+
+// Calculates best action to take given surrounding cell values
+void ExtractPolicy(Map *map)
+{
+	int best_action;
+	Transitions transitions;
+
+	TransitionsInit(&transitions, map);
+
+	// Sweep systematically over the cells
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			// Skip obstructions, holes and goals
+			if (map->cellType[i] == OPEN)
+			{
+				// Best action is the action that corresponds with the maximum value
+				BackupCell(&transitions, map, map->value, i, &best_action, &map->gap[i]);
+				map->action[i] = best_action;
+			}
+		}
+	}
+}
+
+// Calculates new cell value
+float CalculateValue(Map *map, int action, int x, int y)
+{
+	Transitions transitions;
+
+	TransitionsInit(&transitions, map);
+
+	// Return the new value
+	return EvaluateCell(&transitions, map, map->value, MapIndex(map, x, y), action);
+}
+
+// Counts the cells that are backed up by a sweep
+size_t CountOpenCells(const Map *map)
+{
+	size_t open = 0;
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			open += map->cellType[MapIndex(map, x, y)] == OPEN;
+		}
+	}
+	return open;
+}
+
+// Returns the command line name of a solver
+const char *SolverName(Solver solver)
+{
+	return solverNames[solver];
+}
+
+// Returns the name of what stopped a solve
+const char *StopReasonName(StopReason reason)
+{
+	return stopReasonNames[reason];
+}
+
+// Finds the solver with the given command line name, returns false if there is none
+bool SolverFromName(const char *name, Solver *solver)
+{
+	for (int i = 0; i < (int)(sizeof(solverNames) / sizeof(solverNames[0])); i++)
+	{
+		if (strcmp(name, solverNames[i]) == 0)
+		{
+			*solver = (Solver)i;
+			return true;
+		}
+	}
+	return false;
+}
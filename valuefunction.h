@@ -0,0 +1,232 @@
+#ifndef VALUEFUNCTION_H
+#define VALUEFUNCTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Default map dimensions
+#define COLS 20
+#define ROWS 20
+
+// Alignment in bytes of each plane in the grid allocation, one cache line
+#define MAP_ALIGNMENT 64
+
+// Cell property
+typedef enum CellType
+{
+	OPEN, // Free movement through cell
+	GOAL, // Destination
+	HOLE, // Should be avoided
+	OBSTRUCTION // Wall
+} CellType;
+
+// Algorithm ValueIteration uses to compute the value function
+typedef enum Solver
+{
+	GAUSS_SEIDEL, // In-place sweeps on one thread, ComputeValueFunction
+	JACOBI, // Double-buffered sweeps split into row bands across threads, ComputeValueFunctionJacobi
+	RED_BLACK, // In-place sweeps of the even rows then the odd rows across threads, ComputeValueFunctionRedBlack
+	PRIORITIZED, // Backups ordered by Bellman residual, PrioritizedSweeping
+	POLICY_ITERATION, // Policy evaluation to convergence alternating with greedy improvement, PolicyIteration
+	MODIFIED_POLICY_ITERATION, // A fixed number of evaluation sweeps per improvement, ModifiedPolicyIteration
+	MULTIGRID, // In-place sweeps starting from the solution of a coarser grid, Multigrid
+	TILED, // In-place sweeps one band of rows at a time, several per band, for file-backed maps, ComputeValueFunctionTiled
+	BOUNDED, // In-place sweeps of an upper and a lower bound on the values until they meet, BoundedValueIteration
+	FAST_SWEEPING // In-place sweeps cycling through the four combinations of row and column order, ComputeValueFunction
+} Solver;
+
+// Rule the in-place sweeps of ComputeValueFunction stop by
+typedef enum StopRule
+{
+	STOP_ON_DELTA, // The largest change in a sweep is below theta
+	STOP_ON_POLICY // As STOP_ON_DELTA, or as soon as CertifyPolicy proves the greedy policy good enough, needs gamma below 1
+} StopRule;
+
+// What stopped a solve
+typedef enum StopReason
+{
+	STOP_NONE, // Still running, or the solver does not report it
+	STOP_CONVERGED, // The largest change in a sweep was below theta
+	STOP_POLICY_OPTIMAL, // The greedy policy is proven optimal
+	STOP_VALUE_ERROR, // The greedy policy is proven to lose at most valueError against an optimal one
+	STOP_INTERVAL, // The upper and lower bounds on the values were within epsilon of each other
+	STOP_STALLED, // The bounds on the values stopped narrowing before they were within epsilon of each other
+	STOP_MAX_ITERATIONS, // The maximum number of iterations was met
+	STOP_CALLBACK // The sweep callback asked to stop
+} StopReason;
+
+// Information about map
+typedef struct Map
+{
+	float theta; // Sets ccuracy of estimation and tests for covergence, loop until value of change less than theta or max iterations
+	float probability; // Probability of moving to the correct cell, models uncertainty in action
+	// Example: If probability = 0.9, and chosen action is to move right, there is a 0.05 chance it moves top right
+	// and a 0.05 chance it moves bottom right.
+	float gamma; // Discount factor
+	int width; // Number of columns
+	int height; // Number of rows
+	int stride; // Length of a plane row, the grid plus a one cell ghost border either side
+	// Cells are stored row by row in separate planes, the position of a cell is implied by its index
+	// Every plane has a one cell ghost border around the grid so a move off the edge reads memory inside the plane
+	float *value; // Desirability of location in cell
+	uint8_t *cellType; // Cell property, a CellType
+	uint8_t *action; // Integer represents best direction to move out of cell, clockwise with 0 at top
+	float *gap; // Action gap, how much better the best action is than the second best
+	// Transition table, rebuilt by GridInit and ChangeCellType whenever the cell types change
+	uint8_t *blocked; // Bit d is set when a move in direction d leaves the cell in place
+	uint8_t *collide; // Bit d is set when a move in direction d hits an obstruction
+	void *memory; // Single aligned block holding the planes, allocated by MapAlloc or mapped from a file by MapLoad
+	void *mapping; // Whole file mapping, header included, when the planes were mapped by MapLoad, NULL otherwise
+	size_t mappingSize; // Length of the file mapping
+	bool mappingShared; // The file mapping writes through to the file, so its written pages can be flushed and dropped
+	int max_iterations; // Maximum number of loops
+	int movementPenalty; // Cost of movement
+	int collisionPenalty; // Cost of colliding with wall
+	float obstacleDensity; // Fraction of the cells GridInit makes obstructions
+	Solver solver; // Algorithm used by ValueIteration
+	bool warmStart; // An unsolved map's values are seeded from the best paths to the terminals before solving, WarmStart
+	bool reducedPrecision; // Gauss-Seidel stores the values as bf16 for the early sweeps, ComputeValueFunctionReduced
+	bool fusedPolicy; // Record the best action and action gap during the sweeps instead of in a separate ExtractPolicy pass
+	int threads; // Threads used by the parallel solvers, 0 uses every core
+	int evaluationSweeps; // Policy evaluation sweeps per improvement step of modified policy iteration
+	int tileRows; // Rows of a band of the tiled solver, 0 sizes the bands by memory
+	int tileSweeps; // Sweeps the tiled solver makes over a band before moving on to the next
+	StopRule stopRule; // When ComputeValueFunction stops, STOP_ON_DELTA by default
+	float valueError; // Loss of value against an optimal policy that STOP_ON_POLICY accepts, 0 to only accept optimal
+	float epsilon; // Largest gap between the upper and lower bound on a value that the bounded solver stops at
+	StopReason stopReason; // What stopped the last solve
+	// Proven bound at the end of the last solve on the loss of value of the greedy policy, or for the bounded solver on
+	// the distance of the values from optimal, INFINITY if none
+	float errorBound;
+	int iterations; // Sweeps made by the last solve
+	int improvements; // Policy improvement steps made by the last policy iteration solve
+	long long backups; // Cell backups made by the last solve
+	bool solved; // The values have been solved for the grid, so a re-solve can start from them
+	size_t *edits; // Plane indices of the cells changed by ChangeCellType since the last solve
+	size_t editCount;
+	size_t editCapacity;
+	// Called by the solvers after every sweep, or the work of one, with sweepContext. Returning false stops the solve
+	// early. Set to NULL by MapAlloc, which means no callback.
+	bool (*sweepCallback)(struct Map *map, void *context);
+	void *sweepContext;
+	struct Telemetry *telemetry; // Receives a record of every sweep if not NULL, set to NULL by MapAlloc
+} Map;
+
+// Successors, rewards and outcome probabilities shared by every cell, built from the map before a sweep
+// The outcome of moving in direction d from cell i is cell i, if bit d of blocked[i] is set, or cell i + offset[d]
+typedef struct Transitions
+{
+	ptrdiff_t offset[8]; // Change in plane index for a move in each direction, clockwise with 0 at top
+	float reward[8]; // Reward for a move in each direction that does not hit an obstruction
+	float collision; // Reward for a move that hits an obstruction
+	float probability[3]; // Probability of veering anticlockwise, moving in the chosen direction and veering clockwise
+	float gamma; // Discount factor
+} Transitions;
+
+// Returns the plane index of the cell at column x and row y
+static inline size_t MapIndex(const Map *map, int x, int y)
+{
+	return (size_t)(y + 1) * map->stride + x + 1;
+}
+
+// Returns the number of cells in a plane, including the ghost border
+static inline size_t MapPlaneLength(const Map *map)
+{
+	return (size_t)map->stride * (map->height + 2);
+}
+
+// Checks that the index is suitable
+bool IndexIsValid(const Map*, int, int);
+// Returns the size in bytes of the block holding the planes of a width x height grid
+size_t MapBlockSize(int, int);
+// Points the planes of a width x height grid into a block of MapBlockSize bytes, in the order value, action gap, cell
+// type, action, blocked and collide, each starting on its own alignment boundary
+void MapAttach(Map*, int, int, void*);
+// Allocates the planes of a width x height grid as one aligned block
+bool MapAlloc(Map*, int, int);
+// Releases the planes allocated by MapAlloc or mapped by MapLoad
+void MapFree(Map*);
+// Cycles a cell through the different cell types
+void ChangeCellType(Map*, int, int);
+// Adds a plane index to the edits of the next incremental solve, returns false if the list could not grow
+bool MapRecordEdit(Map*, size_t);
+// Reports a finished sweep and its largest change to the telemetry and the sweep callback, returns false if the solve
+// should stop
+bool SweepDone(Map*, float);
+// Returns why a solve should stop after its given number of sweeps, the largest change of the last one and what the
+// sweep callback returned, STOP_NONE if it should carry on
+StopReason SweepStopReason(const Map*, int, float, bool);
+// Makes every cell, including the ghost border, an obstruction with no value or action
+void GridClear(Map*);
+// Initialises each grid and adds random obstacles
+void GridInit(Map*);
+// Builds the blocked and collide masks of every cell
+void TransitionTableInit(Map*);
+// Rebuilds the blocked and collide masks of the cells next to an edited cell
+void TransitionTableUpdate(Map*, int, int);
+// Fills the shared successor offsets, rewards and probabilities from the map parameters
+void TransitionsInit(Transitions*, const Map*);
+// Initialises the map, the grid must already be allocated by MapAlloc
+void MapInit(Map*);
+// Sets the solver parameters and settings to their defaults, leaving the grid alone
+void MapDefaults(Map*);
+// Value Iteration function calls the two following functions
+void ValueIteration(Map*);
+// Loops through grid updating cell values
+// Fast sweeping runs the same sweeps in alternating orders, starting an unsolved map from a lower bound
+void ComputeValueFunction(Map*);
+// Loops through grid with the values stored as bf16 until the changes are too small for it, then as floats
+void ComputeValueFunctionReduced(Map*);
+// Loops through grid on several threads, reading the previous sweep's values from one plane and writing the next
+void ComputeValueFunctionJacobi(Map*);
+// Loops through grid in place on several threads, updating all even rows and then all odd rows
+void ComputeValueFunctionRedBlack(Map*);
+// Backs up the cell with the largest Bellman residual first, and rechecks its predecessors when its value changes
+void PrioritizedSweeping(Map*);
+// Prioritized sweeping that starts only from the given cells and their neighbours and records the policy as it goes
+// Returns false if the queue could not be allocated
+bool PrioritizedSweepingFrom(Map*, const size_t*, size_t);
+// Alternates evaluating the current policy until the values change by less than theta with improving it greedily
+void PolicyIteration(Map*);
+// Alternates evaluationSweeps sweeps of policy evaluation with improving the policy greedily
+void ModifiedPolicyIteration(Map*);
+// Loops through grid a band of rows at a time, sweeping each band several times while it is resident
+void ComputeValueFunctionTiled(Map*);
+// Sweeps an upper and a lower bound on the values until they are within epsilon of each other, then takes their midpoint
+void BoundedValueIteration(Map*);
+// Fills the values of the open cells that can reach a goal or hole with a lower bound on the optimal values and the
+// given plane, unless it is NULL, with an upper bound. Returns false if the map gives no sound bounds.
+bool ValueBoundsInit(Map*, const Transitions*, float*);
+// Seeds the values of the open cells with the value of their best path to a goal or hole if every move went wherever
+// suited it best, found by a search out from every terminal at once, which the sweeps then only lower. Returns false,
+// leaving the values alone, if a move is rewarded or the search could not be allocated.
+bool WarmStart(Map*);
+// Solves a grid coarsened to half the size in each direction, recursively, and sweeps from its interpolated values
+void Multigrid(Map*);
+// Solves every map as ValueIteration would, spreading the maps over the given number of threads, 0 uses every core
+// Small maps of the same size and parameters are interleaved into vector lanes and backed up together
+// Returns false if the work list could not be allocated, the maps are then solved one after another
+bool ValueIterationBatch(Map*, int, int);
+// Re-solves from the current values, only spreading out from the cells edited since the last solve
+void ValueIterationIncremental(Map*);
+// Makes a Jacobi sweep of the values into a scratch plane, recording the greedy policy of the values it reads, and
+// proves a bound on that policy's loss of value from the sweep's Bellman residuals. Returns STOP_POLICY_OPTIMAL or
+// STOP_VALUE_ERROR if the policy is good enough for the map's stopping rule, and then leaves the values as they were,
+// otherwise takes the swept values and returns STOP_NONE. Stores the largest change and the smallest action gap in the
+// last two arguments.
+StopReason CertifyPolicy(Map*, const Transitions*, float*, float*, float*);
+// Calculates best action to take given surrounding cell values
+void ExtractPolicy(Map*);
+// Calculates new cell value
+float CalculateValue(Map*, int, int, int);
+// Counts the cells that are backed up by a sweep
+size_t CountOpenCells(const Map*);
+// Returns the command line name of a solver
+const char *SolverName(Solver);
+// Returns the name of what stopped a solve
+const char *StopReasonName(StopReason);
+// Finds the solver with the given command line name, returns false if there is none
+bool SolverFromName(const char*, Solver*);
+
+#endif
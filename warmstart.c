@@ -0,0 +1,172 @@
+#include <math.h>
+#include <stdlib.h>
+#include "valuefunction.h"
+
+// Marks a cell that is not in the heap
+#define NOT_QUEUED SIZE_MAX
+
+// Binary max-heap of reached cells keyed on the best value found so far for them, each cell at most once, with the heap
+// position of every cell kept so a cell whose value rises is moved up rather than queued again
+typedef struct ValueHeap
+{
+	size_t *cells; // Plane indices of the queued cells, in heap order
+	size_t count;
+	size_t *position; // Heap position of each cell, NOT_QUEUED when it is not queued
+	const float *value; // Value each cell is keyed on
+} ValueHeap;
+
+// Puts a cell at a heap position
+static inline void HeapPlace(ValueHeap *heap, size_t slot, size_t i)
+{
+	heap->cells[slot] = i;
+	heap->position[i] = slot;
+}
+
+// Moves the cell at a heap position up past the parents with a lower value
+static void HeapSiftUp(ValueHeap *heap, size_t slot)
+{
+	size_t i = heap->cells[slot];
+	while (slot > 0 && heap->value[heap->cells[(slot - 1) / 2]] < heap->value[i])
+	{
+		HeapPlace(heap, slot, heap->cells[(slot - 1) / 2]);
+		slot = (slot - 1) / 2;
+	}
+	HeapPlace(heap, slot, i);
+}
+
+// Removes the cell with the highest value from the heap
+static size_t HeapPop(ValueHeap *heap)
+{
+	size_t top = heap->cells[0];
+	heap->position[top] = NOT_QUEUED;
+	if (--heap->count == 0)
+	{
+		return top;
+	}
+
+	// Sift the last cell down from the top of the heap
+	size_t i = heap->cells[heap->count];
+	size_t slot = 0;
+	while (2 * slot + 1 < heap->count)
+	{
+		size_t child = 2 * slot + 1;
+		if (child + 1 < heap->count && heap->value[heap->cells[child + 1]] > heap->value[heap->cells[child]])
+		{
+			child++;
+		}
+		if (heap->value[heap->cells[child]] <= heap->value[i])
+		{
+			break;
+		}
+		HeapPlace(heap, slot, heap->cells[child]);
+		slot = child;
+	}
+	HeapPlace(heap, slot, i);
+	return top;
+}
+
+// Seeds the values of the open cells with the value of their best path to a goal or hole if every move went wherever
+// suited it best, which no action model can beat. Staying in place forever at the mildest penalty is one such path, so
+// with discounting no cell is seeded below it. Above that value a move never raises a path's value, so the cells are
+// taken from a heap in order of falling value, as Dijkstra's search takes them by cost, and each is final when taken.
+// Below it every value found is raised to it anyway. The seeded values are then at least the optimal ones and no
+// backup raises them, so the sweeps only lower them, as they lower the zeros of MapInit. Cells that reach no terminal
+// keep their values. Returns false, leaving the values alone, if a move is rewarded or the search could not be
+// allocated.
+bool WarmStart(Map *map)
+{
+	Transitions transitions;
+	TransitionsInit(&transitions, map);
+
+	float mildest = -INFINITY;
+	for (int d = 0; d < 8; d++)
+	{
+		if (transitions.reward[d] > 0)
+		{
+			return false;
+		}
+		mildest = fmaxf(mildest, transitions.reward[d]);
+	}
+	float floor = transitions.gamma < 1 ? mildest / (1 - transitions.gamma) : -INFINITY;
+
+	size_t cells = MapPlaneLength(map);
+	ValueHeap heap;
+	heap.count = 0;
+	heap.cells = malloc(cells * sizeof(size_t));
+	heap.position = malloc(cells * sizeof(size_t));
+	// Best value of a path found so far from each reached cell
+	float *best = malloc(cells * sizeof(float));
+	// Cells taken from the heap, their values are final
+	uint8_t *settled = calloc(cells, 1);
+	if (heap.cells == NULL || heap.position == NULL || best == NULL || settled == NULL)
+	{
+		free(heap.cells);
+		free(heap.position);
+		free(best);
+		free(settled);
+		return false;
+	}
+	heap.value = best;
+
+	for (size_t i = 0; i < cells; i++)
+	{
+		heap.position[i] = NOT_QUEUED;
+		best[i] = -INFINITY;
+	}
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == GOAL || map->cellType[i] == HOLE)
+			{
+				best[i] = map->value[i];
+				HeapPlace(&heap, heap.count++, i);
+				HeapSiftUp(&heap, heap.position[i]);
+			}
+		}
+	}
+
+	while (heap.count > 0)
+	{
+		size_t k = HeapPop(&heap);
+		settled[k] = 1;
+		for (int d = 0; d < 8; d++)
+		{
+			// The cell a move in direction d would bring here
+			size_t j = k - transitions.offset[d];
+			if (map->cellType[j] != OPEN || map->blocked[j] >> d & 1 || settled[j])
+			{
+				continue;
+			}
+			float value = transitions.reward[d] + transitions.gamma * best[k];
+			if (value > best[j])
+			{
+				best[j] = value;
+				if (heap.position[j] == NOT_QUEUED)
+				{
+					HeapPlace(&heap, heap.count++, j);
+				}
+				HeapSiftUp(&heap, heap.position[j]);
+			}
+		}
+	}
+
+	for (int y = 0; y < map->height; y++)
+	{
+		for (int x = 0; x < map->width; x++)
+		{
+			size_t i = MapIndex(map, x, y);
+			if (map->cellType[i] == OPEN && best[i] != -INFINITY)
+			{
+				map->value[i] = fmaxf(best[i], floor);
+			}
+		}
+	}
+
+	free(heap.cells);
+	free(heap.position);
+	free(best);
+	free(settled);
+	return true;
+}